@@ -2,10 +2,18 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
-    CameraWrapper.cpp
+    CameraWrapper.cpp \
+    CameraParameterFixup.cpp \
+    CameraStats.cpp \
+    CameraTrace.cpp
 
 LOCAL_SHARED_LIBRARIES := \
-    libhardware liblog libcamera_client libutils
+    libhardware liblog libutils libcutils
+
+# queue auto focus and picture ops to a per-camera worker thread
+ifeq ($(BOARD_CAMERA_ASYNC_OPS),true)
+LOCAL_CFLAGS += -DCAMERA_ASYNC_OPS
+endif
 
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_MODULE := camera.$(TARGET_BOARD_PLATFORM)
@@ -13,3 +21,65 @@ LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
 #include $(BUILD_HEAPTRACKED_SHARED_LIBRARY)
+
+# libcamera_client is not built for the host, the benchmarks compile the
+# framework's CameraParameters directly to compare with the original fixups
+camera_parameters_src := ../../../../frameworks/base/libs/camera/CameraParameters.cpp
+
+# wrapper overhead benchmark, runs on the build host against a stub vendor module:
+# out/host/<os>-x86/bin/camera_wrapper_bench [-n iterations] [-d op=usecs]...
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    CameraWrapper.cpp \
+    CameraParameterFixup.cpp \
+    CameraStats.cpp \
+    CameraTrace.cpp \
+    bench/LegacyFixup.cpp \
+    bench/StubVendorCamera.cpp \
+    bench/CameraWrapperBench.cpp \
+    $(camera_parameters_src)
+
+LOCAL_C_INCLUDES := \
+    hardware/libhardware/include \
+    system/core/include \
+    frameworks/base/include
+
+LOCAL_STATIC_LIBRARIES := \
+    libutils libcutils liblog
+
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MODULE := camera_wrapper_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# replays a trace recorded with TRACE_PARAMETERS:
+# out/host/<os>-x86/bin/camera_trace_replay [-v] [-r] [-q] trace
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    CameraWrapper.cpp \
+    CameraParameterFixup.cpp \
+    CameraStats.cpp \
+    CameraTrace.cpp \
+    bench/LegacyFixup.cpp \
+    bench/StubVendorCamera.cpp \
+    bench/CameraTraceReplay.cpp \
+    $(camera_parameters_src)
+
+LOCAL_C_INCLUDES := \
+    hardware/libhardware/include \
+    system/core/include \
+    frameworks/base/include
+
+LOCAL_STATIC_LIBRARIES := \
+    libutils libcutils liblog
+
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MODULE := camera_trace_replay
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,530 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file CameraParameterFixup.cpp
+*
+* Rewrites flattened camera parameter strings according to a static rule
+* table, without building a CameraParameters map.
+*
+*/
+
+#define LOG_TAG "CameraWrapper"
+#include <cutils/log.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CameraParameterFixup.h"
+
+#define MAX_RULES_PER_LIST 16
+
+/* large enough for the exynos parameter strings without growing */
+#define ARENA_INITIAL_SPANS 160
+#define ARENA_INITIAL_BUF_SIZE 4096
+
+/* keys as defined by android::CameraParameters */
+#define KEY_PREVIEW_SIZE "preview-size"
+#define KEY_SUPPORTED_PREVIEW_SIZES "preview-size-values"
+#define KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO "preferred-preview-size-for-video"
+#define KEY_VIDEO_SIZE "video-size"
+#define KEY_SUPPORTED_VIDEO_SIZES "video-size-values"
+
+/* samsung specific, present while the camcorder is active */
+#define KEY_CAM_MODE "cam_mode"
+
+#define BACK_VIDEO_PREVIEW_SIZES "1920x1080,1280x720,640x480"
+#define FRONT_VIDEO_PREVIEW_SIZES "640x480,352x288,320x240,176x144"
+
+/*
+ * Rules are applied in table order, so later rules see the values
+ * written by earlier ones.
+ */
+static const camera_fixup_rule_t fixup_rules[] = {
+    /* get_parameters */
+    { CAMERA_FIXUP_GET, -1, NULL, CAMERA_FIXUP_ACTION_REMOVE,
+            KEY_SUPPORTED_VIDEO_SIZES, NULL },
+    { CAMERA_FIXUP_GET, 0, KEY_CAM_MODE, CAMERA_FIXUP_ACTION_SET,
+            KEY_SUPPORTED_PREVIEW_SIZES, BACK_VIDEO_PREVIEW_SIZES },
+    { CAMERA_FIXUP_GET, 1, KEY_CAM_MODE, CAMERA_FIXUP_ACTION_SET,
+            KEY_SUPPORTED_PREVIEW_SIZES, FRONT_VIDEO_PREVIEW_SIZES },
+    { CAMERA_FIXUP_GET, -1, KEY_CAM_MODE, CAMERA_FIXUP_ACTION_COPY,
+            KEY_PREVIEW_SIZE, KEY_VIDEO_SIZE },
+
+    /* set_parameters */
+    { CAMERA_FIXUP_SET, -1, KEY_CAM_MODE, CAMERA_FIXUP_ACTION_COPY,
+            KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO, KEY_PREVIEW_SIZE },
+    { CAMERA_FIXUP_SET, 0, KEY_CAM_MODE, CAMERA_FIXUP_ACTION_SET,
+            KEY_SUPPORTED_VIDEO_SIZES, BACK_VIDEO_PREVIEW_SIZES },
+    { CAMERA_FIXUP_SET, 1, KEY_CAM_MODE, CAMERA_FIXUP_ACTION_SET,
+            KEY_SUPPORTED_VIDEO_SIZES, FRONT_VIDEO_PREVIEW_SIZES },
+};
+
+/*
+ * Turn set_parameters input into the still or video profile. The SET
+ * rules run afterwards, so the profile gets the same fixups as a set made
+ * by the framework in that mode.
+ */
+static const camera_fixup_rule_t still_profile_rules[] = {
+    { CAMERA_FIXUP_SET, -1, NULL, CAMERA_FIXUP_ACTION_REMOVE,
+            KEY_CAM_MODE, NULL },
+};
+
+static const camera_fixup_rule_t video_profile_rules[] = {
+    { CAMERA_FIXUP_SET, -1, NULL, CAMERA_FIXUP_ACTION_SET,
+            KEY_CAM_MODE, "1" },
+};
+
+typedef struct {
+    camera_fixup_action_t action;
+    const char *key;
+    size_t key_len;
+    const char *arg;
+    size_t arg_len;
+    const char *when;
+    size_t when_len;
+} compiled_rule_t;
+
+typedef struct {
+    int count;
+    compiled_rule_t rules[MAX_RULES_PER_LIST];
+} rule_list_t;
+
+typedef struct camera_fixup_span {
+    const char *key;
+    size_t key_len;
+    const char *value;
+    size_t value_len;
+    int removed;
+} param_span_t;
+
+static pthread_once_t gFixupOnce = PTHREAD_ONCE_INIT;
+static rule_list_t gRuleLists[CAMERA_FIXUP_MAX_CAMERAS][CAMERA_FIXUP_DIRECTIONS];
+static rule_list_t gProfileLists[CAMERA_FIXUP_MAX_CAMERAS][CAMERA_FIXUP_MODES];
+
+static void compile_rule(rule_list_t *list, const camera_fixup_rule_t *rule, int id)
+{
+    if (rule->camera_id >= 0 && rule->camera_id != id)
+        return;
+
+    if (list->count == MAX_RULES_PER_LIST) {
+        LOGE("%s: too many rules for camera %d, dropping %s",
+                __FUNCTION__, id, rule->key);
+        return;
+    }
+
+    compiled_rule_t *c = &list->rules[list->count++];
+    c->action = rule->action;
+    c->key = rule->key;
+    c->key_len = strlen(rule->key);
+    c->arg = rule->arg;
+    c->arg_len = rule->arg ? strlen(rule->arg) : 0;
+    c->when = rule->when;
+    c->when_len = rule->when ? strlen(rule->when) : 0;
+}
+
+static void compile_profile(int id, camera_fixup_mode_t mode,
+        const camera_fixup_rule_t *rules, size_t num_rules)
+{
+    rule_list_t *list = &gProfileLists[id][mode];
+    size_t i;
+
+    for (i = 0; i < num_rules; i++)
+        compile_rule(list, &rules[i], id);
+    for (i = 0; i < sizeof(fixup_rules) / sizeof(fixup_rules[0]); i++) {
+        if (fixup_rules[i].direction == CAMERA_FIXUP_SET)
+            compile_rule(list, &fixup_rules[i], id);
+    }
+}
+
+static void compile_rules(void)
+{
+    size_t i;
+    int id;
+
+    memset(gRuleLists, 0, sizeof(gRuleLists));
+    memset(gProfileLists, 0, sizeof(gProfileLists));
+
+    for (id = 0; id < CAMERA_FIXUP_MAX_CAMERAS; id++) {
+        for (i = 0; i < sizeof(fixup_rules) / sizeof(fixup_rules[0]); i++)
+            compile_rule(&gRuleLists[id][fixup_rules[i].direction], &fixup_rules[i], id);
+
+        compile_profile(id, CAMERA_FIXUP_MODE_STILL, still_profile_rules,
+                sizeof(still_profile_rules) / sizeof(still_profile_rules[0]));
+        compile_profile(id, CAMERA_FIXUP_MODE_VIDEO, video_profile_rules,
+                sizeof(video_profile_rules) / sizeof(video_profile_rules[0]));
+    }
+}
+
+void camera_fixup_init(void)
+{
+    pthread_once(&gFixupOnce, compile_rules);
+}
+
+int camera_fixup_arena_init(camera_fixup_arena_t *arena)
+{
+    arena->spans = (param_span_t *)malloc(ARENA_INITIAL_SPANS * sizeof(param_span_t));
+    arena->buf = (char *)malloc(ARENA_INITIAL_BUF_SIZE);
+    if (!arena->spans || !arena->buf) {
+        camera_fixup_arena_release(arena);
+        return -ENOMEM;
+    }
+    arena->max_spans = ARENA_INITIAL_SPANS;
+    arena->buf_size = ARENA_INITIAL_BUF_SIZE;
+    return 0;
+}
+
+void camera_fixup_arena_release(camera_fixup_arena_t *arena)
+{
+    free(arena->spans);
+    free(arena->buf);
+    memset(arena, 0, sizeof(*arena));
+}
+
+static int grow_spans(camera_fixup_arena_t *arena)
+{
+    int max_spans = arena->max_spans ? arena->max_spans * 2 : ARENA_INITIAL_SPANS;
+    param_span_t *spans = (param_span_t *)realloc(arena->spans,
+            max_spans * sizeof(param_span_t));
+
+    if (!spans)
+        return -ENOMEM;
+    arena->spans = spans;
+    arena->max_spans = max_spans;
+    return 0;
+}
+
+static int reserve_buf(camera_fixup_arena_t *arena, size_t size)
+{
+    char *buf;
+
+    if (size <= arena->buf_size)
+        return 0;
+    if (size < arena->buf_size * 2)
+        size = arena->buf_size * 2;
+
+    buf = (char *)realloc(arena->buf, size);
+    if (!buf)
+        return -ENOMEM;
+    arena->buf = buf;
+    arena->buf_size = size;
+    return 0;
+}
+
+/*
+ * Splits "key=value;key=value" into spans pointing into settings,
+ * returns the number of spans or -ENOMEM.
+ */
+static int tokenize(camera_fixup_arena_t *arena, const char *settings)
+{
+    const char *p = settings;
+    int count = 0;
+
+    while (*p) {
+        const char *end = strchr(p, ';');
+        const char *eq;
+
+        if (!end)
+            end = p + strlen(p);
+
+        eq = (const char *)memchr(p, '=', end - p);
+        if (eq && eq != p) {
+            if (count == arena->max_spans && grow_spans(arena))
+                return -ENOMEM;
+            param_span_t *span = &arena->spans[count++];
+            span->key = p;
+            span->key_len = eq - p;
+            span->value = eq + 1;
+            span->value_len = end - eq - 1;
+            span->removed = 0;
+        }
+
+        p = *end ? end + 1 : end;
+    }
+
+    return count;
+}
+
+static param_span_t *find_span(param_span_t *spans, int count,
+        const char *key, size_t key_len)
+{
+    int i;
+
+    for (i = count - 1; i >= 0; i--) {
+        if (!spans[i].removed && spans[i].key_len == key_len &&
+                !memcmp(spans[i].key, key, key_len))
+            return &spans[i];
+    }
+    return NULL;
+}
+
+static int set_span(camera_fixup_arena_t *arena, int *count,
+        const char *key, size_t key_len, const char *value, size_t value_len)
+{
+    param_span_t *span = find_span(arena->spans, *count, key, key_len);
+
+    if (!span) {
+        if (*count == arena->max_spans && grow_spans(arena))
+            return -ENOMEM;
+        span = &arena->spans[(*count)++];
+        span->key = key;
+        span->key_len = key_len;
+        span->removed = 0;
+    }
+    span->value = value;
+    span->value_len = value_len;
+    return 0;
+}
+
+static const char *apply_rules(camera_fixup_arena_t *arena, const rule_list_t *list,
+        const char *settings)
+{
+    param_span_t *spans;
+    size_t out_len = 0;
+    char *out;
+    int count, i;
+
+    if (!list) {
+        out_len = strlen(settings);
+        if (reserve_buf(arena, out_len + 1))
+            return NULL;
+        memcpy(arena->buf, settings, out_len + 1);
+        return arena->buf;
+    }
+
+    count = tokenize(arena, settings);
+    if (count < 0)
+        return NULL;
+
+    for (i = 0; i < list->count; i++) {
+        const compiled_rule_t *rule = &list->rules[i];
+        param_span_t *span;
+        int rv = 0;
+
+        if (rule->when && !find_span(arena->spans, count, rule->when, rule->when_len))
+            continue;
+
+        switch (rule->action) {
+        case CAMERA_FIXUP_ACTION_SET:
+            rv = set_span(arena, &count, rule->key, rule->key_len,
+                    rule->arg, rule->arg_len);
+            break;
+        case CAMERA_FIXUP_ACTION_REMOVE:
+            while ((span = find_span(arena->spans, count, rule->key, rule->key_len)))
+                span->removed = 1;
+            break;
+        case CAMERA_FIXUP_ACTION_COPY:
+            span = find_span(arena->spans, count, rule->arg, rule->arg_len);
+            if (span) {
+                /* set_span may move the span array */
+                const char *value = span->value;
+                size_t value_len = span->value_len;
+                rv = set_span(arena, &count, rule->key, rule->key_len,
+                        value, value_len);
+            }
+            break;
+        }
+        if (rv)
+            return NULL;
+    }
+
+    spans = arena->spans;
+    for (i = 0; i < count; i++) {
+        if (!spans[i].removed)
+            out_len += spans[i].key_len + spans[i].value_len + 2;
+    }
+
+    if (reserve_buf(arena, out_len + 1))
+        return NULL;
+
+    out = arena->buf;
+    for (i = 0; i < count; i++) {
+        if (spans[i].removed)
+            continue;
+        if (out != arena->buf)
+            *out++ = ';';
+        memcpy(out, spans[i].key, spans[i].key_len);
+        out += spans[i].key_len;
+        *out++ = '=';
+        memcpy(out, spans[i].value, spans[i].value_len);
+        out += spans[i].value_len;
+    }
+    *out = '\0';
+
+    return arena->buf;
+}
+
+const char *camera_fixup_apply(camera_fixup_arena_t *arena, int camera_id,
+        camera_fixup_direction_t direction, const char *settings)
+{
+    if (!settings)
+        return NULL;
+
+    if (camera_id < 0 || camera_id >= CAMERA_FIXUP_MAX_CAMERAS)
+        return apply_rules(arena, NULL, settings);
+
+    camera_fixup_init();
+    return apply_rules(arena, &gRuleLists[camera_id][direction], settings);
+}
+
+const char *camera_fixup_apply_profile(camera_fixup_arena_t *arena, int camera_id,
+        camera_fixup_mode_t mode, const char *settings)
+{
+    if (!settings)
+        return NULL;
+
+    if (camera_id < 0 || camera_id >= CAMERA_FIXUP_MAX_CAMERAS)
+        return apply_rules(arena, NULL, settings);
+
+    camera_fixup_init();
+    return apply_rules(arena, &gProfileLists[camera_id][mode], settings);
+}
+
+camera_fixup_mode_t camera_fixup_get_mode(const char *settings)
+{
+    char value[2];
+
+    /* the SET rules key on the presence of cam_mode, not its value */
+    if (!camera_fixup_get_value(settings, KEY_CAM_MODE, value, sizeof(value)))
+        return CAMERA_FIXUP_MODE_VIDEO;
+    return CAMERA_FIXUP_MODE_STILL;
+}
+
+char *camera_fixup_params(int camera_id, camera_fixup_direction_t direction,
+        const char *settings)
+{
+    camera_fixup_arena_t arena;
+    const char *fixed;
+    char *ret = NULL;
+
+    if (camera_fixup_arena_init(&arena))
+        return NULL;
+
+    fixed = camera_fixup_apply(&arena, camera_id, direction, settings);
+    if (fixed)
+        ret = strdup(fixed);
+
+    camera_fixup_arena_release(&arena);
+    return ret;
+}
+
+int camera_fixup_get_value(const char *settings, const char *key,
+        char *value, size_t size)
+{
+    size_t key_len = strlen(key);
+    const char *p = settings;
+
+    while (p && *p) {
+        const char *end = strchr(p, ';');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+
+        if (len > key_len && p[key_len] == '=' && !memcmp(p, key, key_len)) {
+            len -= key_len + 1;
+            if (len >= size)
+                len = size - 1;
+            memcpy(value, p + key_len + 1, len);
+            value[len] = '\0';
+            return 0;
+        }
+
+        p = end ? end + 1 : NULL;
+    }
+
+    return -ENOENT;
+}
+
+static int compare_span_keys(const void *a, const void *b)
+{
+    const param_span_t *sa = (const param_span_t *)a;
+    const param_span_t *sb = (const param_span_t *)b;
+    size_t len = sa->key_len < sb->key_len ? sa->key_len : sb->key_len;
+    int ret = memcmp(sa->key, sb->key, len);
+
+    if (ret)
+        return ret;
+    return (int)sa->key_len - (int)sb->key_len;
+}
+
+int camera_fixup_snapshot(camera_fixup_arena_t *snapshot, const char *settings)
+{
+    size_t len = strlen(settings);
+    int count;
+
+    snapshot->num_spans = 0;
+    if (reserve_buf(snapshot, len + 1))
+        return -ENOMEM;
+    memcpy(snapshot->buf, settings, len + 1);
+
+    count = tokenize(snapshot, snapshot->buf);
+    if (count < 0)
+        return count;
+
+    qsort(snapshot->spans, count, sizeof(param_span_t), compare_span_keys);
+    snapshot->num_spans = count;
+    return 0;
+}
+
+int camera_fixup_diff(camera_fixup_arena_t *scratch, const camera_fixup_arena_t *snapshot,
+        const char *settings, camera_fixup_changed_cb changed, void *cookie)
+{
+    const param_span_t *old_spans = snapshot->spans;
+    const param_span_t *new_spans;
+    int old_count = snapshot->num_spans;
+    int new_count, i = 0, j = 0, diffs = 0;
+
+    new_count = tokenize(scratch, settings);
+    if (new_count < 0)
+        return new_count;
+
+    new_spans = scratch->spans;
+    qsort(scratch->spans, new_count, sizeof(param_span_t), compare_span_keys);
+
+    while (i < old_count || j < new_count) {
+        const param_span_t *key_span;
+        int cmp;
+
+        if (i == old_count)
+            cmp = 1;
+        else if (j == new_count)
+            cmp = -1;
+        else
+            cmp = compare_span_keys(&old_spans[i], &new_spans[j]);
+
+        if (cmp < 0) {
+            key_span = &old_spans[i++];
+        } else if (cmp > 0) {
+            key_span = &new_spans[j++];
+        } else {
+            key_span = &new_spans[j];
+            if (old_spans[i].value_len == new_spans[j].value_len &&
+                    !memcmp(old_spans[i].value, new_spans[j].value,
+                            new_spans[j].value_len))
+                key_span = NULL;
+            i++;
+            j++;
+        }
+
+        if (key_span) {
+            diffs++;
+            if (changed)
+                changed(key_span->key, key_span->key_len, cookie);
+        }
+    }
+
+    return diffs;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file CameraParameterFixup.h
+*
+* Table driven rewriting of flattened ("key=value;key=value") camera
+* parameter strings passed between the framework and the vendor HAL.
+*
+*/
+
+#ifndef CAMERA_PARAMETER_FIXUP_H
+#define CAMERA_PARAMETER_FIXUP_H
+
+#define CAMERA_FIXUP_MAX_CAMERAS 2
+
+typedef enum {
+    /* parameters returned by the vendor get_parameters */
+    CAMERA_FIXUP_GET = 0,
+    /* parameters passed to the vendor set_parameters */
+    CAMERA_FIXUP_SET,
+    CAMERA_FIXUP_DIRECTIONS
+} camera_fixup_direction_t;
+
+typedef enum {
+    CAMERA_FIXUP_MODE_STILL = 0,
+    /* camcorder, samsung's cam_mode is set */
+    CAMERA_FIXUP_MODE_VIDEO,
+    CAMERA_FIXUP_MODES
+} camera_fixup_mode_t;
+
+typedef enum {
+    /* key = arg, added when missing */
+    CAMERA_FIXUP_ACTION_SET,
+    /* drop key */
+    CAMERA_FIXUP_ACTION_REMOVE,
+    /* key = current value of key arg, skipped when arg is missing */
+    CAMERA_FIXUP_ACTION_COPY
+} camera_fixup_action_t;
+
+typedef struct {
+    camera_fixup_direction_t direction;
+    /* camera id the rule applies to, -1 for all cameras */
+    int camera_id;
+    /* rule only applies when this key is present, NULL to always apply */
+    const char *when;
+    camera_fixup_action_t action;
+    const char *key;
+    const char *arg;
+} camera_fixup_rule_t;
+
+struct camera_fixup_span;
+
+/*
+ * Scratch space for camera_fixup_apply. Grows on demand and is then reused,
+ * so a steady stream of parameter strings does not allocate.
+ */
+typedef struct {
+    struct camera_fixup_span *spans;
+    int max_spans;
+    /* spans in use after camera_fixup_snapshot */
+    int num_spans;
+    char *buf;
+    size_t buf_size;
+} camera_fixup_arena_t;
+
+/* called by camera_fixup_diff for every key that differs */
+typedef void (*camera_fixup_changed_cb)(const char *key, size_t key_len, void *cookie);
+
+int camera_fixup_arena_init(camera_fixup_arena_t *arena);
+void camera_fixup_arena_release(camera_fixup_arena_t *arena);
+
+/*
+ * Compiles the built-in rule table into per camera id rule lists.
+ * Safe to call more than once, only the first call does any work.
+ */
+void camera_fixup_init(void);
+
+/*
+ * Applies the compiled rules for the given camera id and direction. The
+ * result lives in the arena and stays valid until its next use.
+ * Returns NULL on allocation failure.
+ */
+const char *camera_fixup_apply(camera_fixup_arena_t *arena, int camera_id,
+        camera_fixup_direction_t direction, const char *settings);
+
+/*
+ * Like camera_fixup_apply with CAMERA_FIXUP_SET, after first switching
+ * settings to the still or video profile. Used to prepare a mode switch
+ * before the framework asks for it.
+ */
+const char *camera_fixup_apply_profile(camera_fixup_arena_t *arena, int camera_id,
+        camera_fixup_mode_t mode, const char *settings);
+
+/* the mode a set_parameters string selects */
+camera_fixup_mode_t camera_fixup_get_mode(const char *settings);
+
+/*
+ * Same as camera_fixup_apply but returns a malloc'ed copy, for callers
+ * without an arena.
+ */
+char *camera_fixup_params(int camera_id, camera_fixup_direction_t direction,
+        const char *settings);
+
+/*
+ * Copies the value of key in settings into value (truncated, always
+ * terminated). Returns 0, or -ENOENT when the key is missing.
+ */
+int camera_fixup_get_value(const char *settings, const char *key,
+        char *value, size_t size);
+
+/*
+ * Copies settings into the arena and indexes it by key, as the reference
+ * for later camera_fixup_diff calls. Returns 0 or -ENOMEM.
+ */
+int camera_fixup_snapshot(camera_fixup_arena_t *snapshot, const char *settings);
+
+/*
+ * Compares settings with a snapshot key by key, ignoring key order. Only
+ * the spans of the scratch arena are used, so the arena settings points
+ * into can be passed. changed may be NULL.
+ * Returns the number of keys added, removed or changed, or -ENOMEM.
+ */
+int camera_fixup_diff(camera_fixup_arena_t *scratch, const camera_fixup_arena_t *snapshot,
+        const char *settings, camera_fixup_changed_cb changed, void *cookie);
+
+#endif /* CAMERA_PARAMETER_FIXUP_H */
@@ -0,0 +1,435 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file CameraStats.cpp
+*
+* Statistics collected by the camera wrapper.
+*
+*/
+
+#define LOG_TAG "CameraWrapper"
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CameraStats.h"
+
+#define LATENCY_BUCKET0_US 32
+
+/* frames needed before the mean interval is trusted for drop estimates */
+#define FRAME_STATS_WARMUP 8
+
+void camera_latency_reset(camera_latency_t *latency)
+{
+    int i;
+
+    android_atomic_release_store(0, &latency->count);
+    android_atomic_release_store(0, &latency->total_lo_us);
+    android_atomic_release_store(0, &latency->total_hi_us);
+    android_atomic_release_store(0, &latency->max_us);
+    for (i = 0; i < CAMERA_LATENCY_BUCKETS; i++)
+        android_atomic_release_store(0, &latency->buckets[i]);
+}
+
+void camera_latency_record(camera_latency_t *latency, nsecs_t elapsed)
+{
+    int32_t us = (int32_t)ns2us(elapsed);
+    int32_t lo, max;
+    int bucket = 0;
+
+    while (bucket < CAMERA_LATENCY_BUCKETS - 1 && us >= (LATENCY_BUCKET0_US << bucket))
+        bucket++;
+
+    android_atomic_inc(&latency->buckets[bucket]);
+    android_atomic_inc(&latency->count);
+    /* the low word wrapped, carry into the high one */
+    lo = android_atomic_add(us, &latency->total_lo_us);
+    if ((uint32_t)lo + (uint32_t)us < (uint32_t)lo)
+        android_atomic_inc(&latency->total_hi_us);
+
+    do {
+        max = latency->max_us;
+        if (us <= max)
+            break;
+    } while (android_atomic_cmpxchg(max, us, &latency->max_us));
+}
+
+/*
+ * Both words of the total, read again if a carry came in between. A
+ * reader right between a wrap and its carry still sees the total 2^32us
+ * short, for as long as the recording thread takes to add the carry.
+ */
+static int64_t camera_latency_total_us(const camera_latency_t *latency)
+{
+    int32_t hi, lo;
+
+    do {
+        hi = android_atomic_acquire_load(&latency->total_hi_us);
+        lo = android_atomic_acquire_load(&latency->total_lo_us);
+    } while (hi != android_atomic_acquire_load(&latency->total_hi_us));
+    return (int64_t)(((uint64_t)(uint32_t)hi << 32) | (uint32_t)lo);
+}
+
+int32_t camera_latency_avg_us(const camera_latency_t *latency)
+{
+    int32_t count = android_atomic_acquire_load(&latency->count);
+
+    return count > 0 ? (int32_t)(camera_latency_total_us(latency) / count) : 0;
+}
+
+/* upper bound of the bucket holding the given percentile, capped by the max */
+static int32_t camera_latency_percentile(const camera_latency_t *latency,
+        int32_t count, int percent)
+{
+    int32_t rank = (int32_t)(((int64_t)count * percent + 99) / 100);
+    int32_t seen = 0;
+    int i;
+
+    for (i = 0; i < CAMERA_LATENCY_BUCKETS - 1; i++) {
+        seen += latency->buckets[i];
+        if (seen >= rank)
+            break;
+    }
+
+    if (i == CAMERA_LATENCY_BUCKETS - 1 || (LATENCY_BUCKET0_US << i) > latency->max_us)
+        return latency->max_us;
+    return LATENCY_BUCKET0_US << i;
+}
+
+void camera_latency_dump(int fd, const char *prefix, const camera_latency_t *latency)
+{
+    int32_t count = android_atomic_acquire_load(&latency->count);
+
+    if (count <= 0)
+        return;
+
+    camera_dump_printf(fd, "%s.count=%d\n", prefix, count);
+    camera_dump_printf(fd, "%s.avg_us=%lld\n", prefix,
+            (long long)(camera_latency_total_us(latency) / count));
+    camera_dump_printf(fd, "%s.max_us=%d\n", prefix, latency->max_us);
+    camera_dump_printf(fd, "%s.p50_us=%d\n", prefix,
+            camera_latency_percentile(latency, count, 50));
+    camera_dump_printf(fd, "%s.p95_us=%d\n", prefix,
+            camera_latency_percentile(latency, count, 95));
+    camera_dump_printf(fd, "%s.p99_us=%d\n", prefix,
+            camera_latency_percentile(latency, count, 99));
+}
+
+void camera_frame_stats_init(camera_frame_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_init(&stats->lock, NULL);
+}
+
+void camera_frame_stats_destroy(camera_frame_stats_t *stats)
+{
+    pthread_mutex_destroy(&stats->lock);
+}
+
+void camera_frame_stats_reset(camera_frame_stats_t *stats)
+{
+    pthread_mutex_lock(&stats->lock);
+    stats->frames = 0;
+    stats->dropped = 0;
+    stats->first_frame = 0;
+    stats->last_frame = 0;
+    stats->mean_interval = 0;
+    stats->jitter = 0;
+    stats->max_interval = 0;
+    pthread_mutex_unlock(&stats->lock);
+    camera_latency_reset(&stats->callback_latency);
+}
+
+void camera_frame_stats_record(camera_frame_stats_t *stats, nsecs_t timestamp)
+{
+    pthread_mutex_lock(&stats->lock);
+
+    if (stats->frames++ == 0) {
+        stats->first_frame = timestamp;
+        stats->last_frame = timestamp;
+        pthread_mutex_unlock(&stats->lock);
+        return;
+    }
+
+    nsecs_t interval = timestamp - stats->last_frame;
+    stats->last_frame = timestamp;
+
+    if (interval > stats->max_interval)
+        stats->max_interval = interval;
+
+    if (stats->mean_interval == 0) {
+        stats->mean_interval = interval;
+    } else {
+        nsecs_t deviation = interval - stats->mean_interval;
+
+        if (stats->frames > FRAME_STATS_WARMUP &&
+                interval > stats->mean_interval + stats->mean_interval / 2) {
+            /* count the frames that should have arrived in the gap */
+            stats->dropped += (interval + stats->mean_interval / 2) /
+                    stats->mean_interval - 1;
+        } else {
+            /* do not let gaps drag the mean away from the frame rate */
+            stats->mean_interval += deviation / 16;
+        }
+
+        if (deviation < 0)
+            deviation = -deviation;
+        stats->jitter += (deviation - stats->jitter) / 16;
+    }
+
+    pthread_mutex_unlock(&stats->lock);
+}
+
+int32_t camera_frame_stats_get(camera_frame_stats_t *stats, camera_frame_stat_t stat)
+{
+    int32_t ret = 0;
+
+    pthread_mutex_lock(&stats->lock);
+    switch (stat) {
+    case CAMERA_FRAME_STAT_FPS_X100:
+        if (stats->frames > 1 && stats->last_frame > stats->first_frame)
+            ret = (int32_t)((int64_t)(stats->frames - 1) * 100000000000LL /
+                    (stats->last_frame - stats->first_frame));
+        break;
+    case CAMERA_FRAME_STAT_MEAN_INTERVAL_US:
+        ret = (int32_t)ns2us(stats->mean_interval);
+        break;
+    case CAMERA_FRAME_STAT_JITTER_US:
+        ret = (int32_t)ns2us(stats->jitter);
+        break;
+    case CAMERA_FRAME_STAT_MAX_INTERVAL_US:
+        ret = (int32_t)ns2us(stats->max_interval);
+        break;
+    case CAMERA_FRAME_STAT_FRAMES:
+        ret = stats->frames;
+        break;
+    case CAMERA_FRAME_STAT_DROPPED:
+        ret = stats->dropped;
+        break;
+    case CAMERA_FRAME_STAT_CALLBACK_AVG_US:
+        ret = camera_latency_avg_us(&stats->callback_latency);
+        break;
+    }
+    pthread_mutex_unlock(&stats->lock);
+    return ret;
+}
+
+void camera_frame_stats_dump(int fd, const char *prefix, camera_frame_stats_t *stats)
+{
+    int32_t fps = camera_frame_stats_get(stats, CAMERA_FRAME_STAT_FPS_X100);
+    char name[CAMERA_DUMP_PREFIX_MAX];
+
+    camera_dump_printf(fd, "%s.frames=%d\n", prefix,
+            camera_frame_stats_get(stats, CAMERA_FRAME_STAT_FRAMES));
+    camera_dump_printf(fd, "%s.fps=%d.%02d\n", prefix, fps / 100, fps % 100);
+    camera_dump_printf(fd, "%s.interval_us=%d\n", prefix,
+            camera_frame_stats_get(stats, CAMERA_FRAME_STAT_MEAN_INTERVAL_US));
+    camera_dump_printf(fd, "%s.jitter_us=%d\n", prefix,
+            camera_frame_stats_get(stats, CAMERA_FRAME_STAT_JITTER_US));
+    camera_dump_printf(fd, "%s.max_interval_us=%d\n", prefix,
+            camera_frame_stats_get(stats, CAMERA_FRAME_STAT_MAX_INTERVAL_US));
+    camera_dump_printf(fd, "%s.dropped=%d\n", prefix,
+            camera_frame_stats_get(stats, CAMERA_FRAME_STAT_DROPPED));
+
+    snprintf(name, sizeof(name), "%s.callback", prefix);
+    camera_latency_dump(fd, name, &stats->callback_latency);
+}
+
+void camera_buffer_stats_init(camera_buffer_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_init(&stats->lock, NULL);
+}
+
+void camera_buffer_stats_destroy(camera_buffer_stats_t *stats)
+{
+    pthread_mutex_destroy(&stats->lock);
+}
+
+void camera_buffer_stats_reset(camera_buffer_stats_t *stats)
+{
+    pthread_mutex_lock(&stats->lock);
+    stats->num_in_flight = 0;
+    stats->high_water = 0;
+    stats->exhaustion_warned = 0;
+    stats->delivered = 0;
+    stats->released = 0;
+    stats->unknown_releases = 0;
+    pthread_mutex_unlock(&stats->lock);
+    camera_latency_reset(&stats->hold_latency);
+}
+
+void camera_buffer_stats_memory(camera_buffer_stats_t *stats, const camera_memory_t *mem,
+        size_t buf_size, unsigned int num_bufs)
+{
+    camera_buffer_memory_t *entry;
+
+    if (!mem)
+        return;
+
+    pthread_mutex_lock(&stats->lock);
+    entry = &stats->memories[stats->next_memory];
+    stats->next_memory = (stats->next_memory + 1) % CAMERA_BUFFER_MAX_MEMORIES;
+    entry->data = mem->data;
+    entry->buf_size = buf_size;
+    entry->num_bufs = num_bufs;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void camera_buffer_stats_metadata_mode(camera_buffer_stats_t *stats, int enable)
+{
+    pthread_mutex_lock(&stats->lock);
+    stats->metadata_mode = enable;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void camera_buffer_stats_deliver(camera_buffer_stats_t *stats, int camera_id,
+        const camera_memory_t *mem, unsigned int index, nsecs_t now)
+{
+    const camera_buffer_memory_t *memory = NULL;
+    int i;
+
+    pthread_mutex_lock(&stats->lock);
+    stats->delivered++;
+
+    for (i = 0; i < CAMERA_BUFFER_MAX_MEMORIES; i++) {
+        if (mem && stats->memories[i].data == mem->data) {
+            memory = &stats->memories[i];
+            break;
+        }
+    }
+
+    /* without the pool geometry the release address cannot be predicted */
+    if (!memory || index >= memory->num_bufs ||
+            stats->num_in_flight == CAMERA_BUFFER_MAX_IN_FLIGHT) {
+        pthread_mutex_unlock(&stats->lock);
+        return;
+    }
+
+    stats->in_flight[stats->num_in_flight].opaque =
+            (const char *)memory->data + index * memory->buf_size;
+    stats->in_flight[stats->num_in_flight].delivered = now;
+    stats->num_in_flight++;
+    stats->pool_size = memory->num_bufs;
+
+    if (stats->num_in_flight > stats->high_water)
+        stats->high_water = stats->num_in_flight;
+
+    /* the vendor has at most one buffer left to fill */
+    if (!stats->exhaustion_warned && stats->pool_size > 1 &&
+            stats->num_in_flight >= (int)stats->pool_size - 1) {
+        stats->exhaustion_warned = 1;
+        LOGW("camera %d: %d of %u recording buffers held by the encoder",
+                camera_id, stats->num_in_flight, stats->pool_size);
+    }
+
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void camera_buffer_stats_release(camera_buffer_stats_t *stats, const void *opaque,
+        nsecs_t now)
+{
+    int i;
+
+    pthread_mutex_lock(&stats->lock);
+    stats->released++;
+
+    for (i = 0; i < stats->num_in_flight; i++) {
+        if (stats->in_flight[i].opaque == opaque)
+            break;
+    }
+
+    if (i == stats->num_in_flight) {
+        stats->unknown_releases++;
+        pthread_mutex_unlock(&stats->lock);
+        return;
+    }
+
+    camera_latency_record(&stats->hold_latency, now - stats->in_flight[i].delivered);
+    stats->in_flight[i] = stats->in_flight[--stats->num_in_flight];
+
+    /* warn again only once the encoder has caught up */
+    if (stats->num_in_flight <= (int)stats->pool_size / 2)
+        stats->exhaustion_warned = 0;
+
+    pthread_mutex_unlock(&stats->lock);
+}
+
+int32_t camera_buffer_stats_get(camera_buffer_stats_t *stats, camera_buffer_stat_t stat)
+{
+    int32_t ret = 0;
+
+    pthread_mutex_lock(&stats->lock);
+    switch (stat) {
+    case CAMERA_BUFFER_STAT_IN_FLIGHT:
+        ret = stats->num_in_flight;
+        break;
+    case CAMERA_BUFFER_STAT_HIGH_WATER:
+        ret = stats->high_water;
+        break;
+    case CAMERA_BUFFER_STAT_POOL_SIZE:
+        ret = stats->pool_size;
+        break;
+    case CAMERA_BUFFER_STAT_HOLD_AVG_US:
+        ret = camera_latency_avg_us(&stats->hold_latency);
+        break;
+    case CAMERA_BUFFER_STAT_HOLD_MAX_US:
+        ret = stats->hold_latency.max_us;
+        break;
+    }
+    pthread_mutex_unlock(&stats->lock);
+    return ret;
+}
+
+void camera_buffer_stats_dump(int fd, const char *prefix, camera_buffer_stats_t *stats)
+{
+    char name[CAMERA_DUMP_PREFIX_MAX];
+
+    pthread_mutex_lock(&stats->lock);
+    camera_dump_printf(fd, "%s.metadata_mode=%d\n", prefix, stats->metadata_mode);
+    camera_dump_printf(fd, "%s.pool=%u\n", prefix, stats->pool_size);
+    camera_dump_printf(fd, "%s.in_flight=%d\n", prefix, stats->num_in_flight);
+    camera_dump_printf(fd, "%s.high_water=%d\n", prefix, stats->high_water);
+    camera_dump_printf(fd, "%s.delivered=%u\n", prefix, stats->delivered);
+    camera_dump_printf(fd, "%s.released=%u\n", prefix, stats->released);
+    camera_dump_printf(fd, "%s.unknown_releases=%u\n", prefix, stats->unknown_releases);
+    pthread_mutex_unlock(&stats->lock);
+
+    snprintf(name, sizeof(name), "%s.hold", prefix);
+    camera_latency_dump(fd, name, &stats->hold_latency);
+}
+
+void camera_dump_printf(int fd, const char *fmt, ...)
+{
+    char buf[512];
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    if (len < 0)
+        return;
+    if (len >= (int)sizeof(buf))
+        len = sizeof(buf) - 1;
+    write(fd, buf, len);
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file CameraStats.h
+*
+* Statistics collected by the camera wrapper and the dump helpers
+* that print them.
+*
+*/
+
+#ifndef CAMERA_STATS_H
+#define CAMERA_STATS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/Timers.h>
+#include <hardware/camera.h>
+
+/* bucket i counts calls shorter than 32us << i, the last one everything else */
+#define CAMERA_LATENCY_BUCKETS 16
+
+/*
+ * Updated with atomics only, so any thread can record without locking.
+ * The total is 64 bit, kept in two words: hold times of recording buffers
+ * add up to more than an int32 of microseconds within minutes.
+ */
+typedef struct {
+    volatile int32_t count;
+    volatile int32_t total_lo_us;
+    volatile int32_t total_hi_us;
+    volatile int32_t max_us;
+    volatile int32_t buckets[CAMERA_LATENCY_BUCKETS];
+} camera_latency_t;
+
+/*
+ * The dump functions write "prefix.key=value" lines, one value per line,
+ * so dumpsys output can be parsed without knowing the layout.
+ */
+#define CAMERA_DUMP_PREFIX_MAX 64
+
+/* a record racing the reset may still land partly in the new period */
+void camera_latency_reset(camera_latency_t *latency);
+void camera_latency_record(camera_latency_t *latency, nsecs_t elapsed);
+/* 0 if nothing was recorded */
+int32_t camera_latency_avg_us(const camera_latency_t *latency);
+/* count, average, max and bucket-resolution percentiles; nothing if unused */
+void camera_latency_dump(int fd, const char *prefix, const camera_latency_t *latency);
+
+/*
+ * Inter-frame timing of one stream. Intervals and jitter are exponentially
+ * weighted (1/16), jitter being the mean deviation from the mean interval.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t frames;
+    uint32_t dropped;
+    nsecs_t first_frame;
+    nsecs_t last_frame;
+    nsecs_t mean_interval;
+    nsecs_t jitter;
+    nsecs_t max_interval;
+    /* time spent in the framework's callback */
+    camera_latency_t callback_latency;
+} camera_frame_stats_t;
+
+typedef enum {
+    CAMERA_FRAME_STAT_FPS_X100,
+    CAMERA_FRAME_STAT_MEAN_INTERVAL_US,
+    CAMERA_FRAME_STAT_JITTER_US,
+    CAMERA_FRAME_STAT_MAX_INTERVAL_US,
+    CAMERA_FRAME_STAT_FRAMES,
+    CAMERA_FRAME_STAT_DROPPED,
+    CAMERA_FRAME_STAT_CALLBACK_AVG_US,
+} camera_frame_stat_t;
+
+void camera_frame_stats_init(camera_frame_stats_t *stats);
+void camera_frame_stats_destroy(camera_frame_stats_t *stats);
+void camera_frame_stats_reset(camera_frame_stats_t *stats);
+void camera_frame_stats_record(camera_frame_stats_t *stats, nsecs_t timestamp);
+int32_t camera_frame_stats_get(camera_frame_stats_t *stats, camera_frame_stat_t stat);
+void camera_frame_stats_dump(int fd, const char *prefix, camera_frame_stats_t *stats);
+
+/* allocations remembered to map a delivered frame back to its pool */
+#define CAMERA_BUFFER_MAX_MEMORIES 8
+/* frames tracked between delivery and release */
+#define CAMERA_BUFFER_MAX_IN_FLIGHT 32
+
+typedef struct {
+    const void *data;
+    size_t buf_size;
+    unsigned int num_bufs;
+} camera_buffer_memory_t;
+
+typedef struct {
+    const void *opaque;
+    nsecs_t delivered;
+} camera_buffer_in_flight_t;
+
+/*
+ * Recording buffers handed to the framework and not released yet. The
+ * framework releases a frame by the address of its buffer, which is the
+ * memory's data plus index * buf_size of the get_memory request.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    camera_buffer_memory_t memories[CAMERA_BUFFER_MAX_MEMORIES];
+    int next_memory;
+    camera_buffer_in_flight_t in_flight[CAMERA_BUFFER_MAX_IN_FLIGHT];
+    int num_in_flight;
+    int high_water;
+    /* buffers in the pool of the last delivered frame, 0 if unknown */
+    unsigned int pool_size;
+    int exhaustion_warned;
+    uint32_t delivered;
+    uint32_t released;
+    /* releases of buffers that were not tracked */
+    uint32_t unknown_releases;
+    int metadata_mode;
+    /* delivery to release, i.e. how long the encoder holds a buffer */
+    camera_latency_t hold_latency;
+} camera_buffer_stats_t;
+
+typedef enum {
+    CAMERA_BUFFER_STAT_IN_FLIGHT,
+    CAMERA_BUFFER_STAT_HIGH_WATER,
+    CAMERA_BUFFER_STAT_POOL_SIZE,
+    CAMERA_BUFFER_STAT_HOLD_AVG_US,
+    CAMERA_BUFFER_STAT_HOLD_MAX_US,
+} camera_buffer_stat_t;
+
+void camera_buffer_stats_init(camera_buffer_stats_t *stats);
+void camera_buffer_stats_destroy(camera_buffer_stats_t *stats);
+/* forgets the in-flight buffers and counters, keeps known memories */
+void camera_buffer_stats_reset(camera_buffer_stats_t *stats);
+void camera_buffer_stats_memory(camera_buffer_stats_t *stats, const camera_memory_t *mem,
+        size_t buf_size, unsigned int num_bufs);
+void camera_buffer_stats_metadata_mode(camera_buffer_stats_t *stats, int enable);
+void camera_buffer_stats_deliver(camera_buffer_stats_t *stats, int camera_id,
+        const camera_memory_t *mem, unsigned int index, nsecs_t now);
+void camera_buffer_stats_release(camera_buffer_stats_t *stats, const void *opaque,
+        nsecs_t now);
+int32_t camera_buffer_stats_get(camera_buffer_stats_t *stats, camera_buffer_stat_t stat);
+void camera_buffer_stats_dump(int fd, const char *prefix, camera_buffer_stats_t *stats);
+
+void camera_dump_printf(int fd, const char *fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+
+#endif /* CAMERA_STATS_H */
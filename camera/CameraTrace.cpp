@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file CameraTrace.cpp
+*
+* Binary trace of the ops passing through the camera wrapper.
+*
+*/
+
+#define LOG_TAG "CameraWrapper"
+#include <cutils/log.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "CameraTrace.h"
+
+#define CAMERA_OP_NAME(op) #op,
+
+static const char *camera_op_names[CAMERA_OP_COUNT] = {
+    CAMERA_DEVICE_OPS(CAMERA_OP_NAME)
+};
+
+static pthread_mutex_t gTraceLock = PTHREAD_MUTEX_INITIALIZER;
+static int gTraceFd = -1;
+
+const char *camera_trace_op_name(int op)
+{
+    if (op >= 0 && op < CAMERA_OP_COUNT)
+        return camera_op_names[op];
+
+    switch (op) {
+    case CAMERA_TRACE_PARAMS:
+        return "params";
+    case CAMERA_TRACE_OPEN:
+        return "open";
+    case CAMERA_TRACE_CLOSE:
+        return "close";
+    }
+    return "unknown";
+}
+
+int camera_trace_start(const char *path)
+{
+    camera_trace_header_t header;
+    int fd;
+
+    pthread_mutex_lock(&gTraceLock);
+    if (gTraceFd >= 0) {
+        pthread_mutex_unlock(&gTraceLock);
+        return 0;
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0660);
+    if (fd < 0) {
+        LOGE("%s: cannot open %s: %s", __FUNCTION__, path, strerror(errno));
+        pthread_mutex_unlock(&gTraceLock);
+        return -errno;
+    }
+
+    header.magic = CAMERA_TRACE_MAGIC;
+    header.version = CAMERA_TRACE_VERSION;
+    if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+        close(fd);
+        pthread_mutex_unlock(&gTraceLock);
+        return -EIO;
+    }
+
+    LOGI("%s: tracing camera ops to %s", __FUNCTION__, path);
+    gTraceFd = fd;
+    pthread_mutex_unlock(&gTraceLock);
+    return 0;
+}
+
+static void trace_write(camera_trace_record_t *record, const char *before,
+        const char *after)
+{
+    struct iovec iov[3];
+    int count = 1;
+
+    iov[0].iov_base = record;
+    iov[0].iov_len = sizeof(*record);
+    if (record->before_len) {
+        iov[count].iov_base = (void *)before;
+        iov[count++].iov_len = record->before_len;
+    }
+    if (record->after_len && record->after_len != CAMERA_TRACE_SAME_AFTER) {
+        iov[count].iov_base = (void *)after;
+        iov[count++].iov_len = record->after_len;
+    }
+
+    /* one writev per record keeps records whole when cameras trace at once */
+    pthread_mutex_lock(&gTraceLock);
+    if (gTraceFd >= 0 && writev(gTraceFd, iov, count) < 0) {
+        LOGE("%s: trace stopped: %s", __FUNCTION__, strerror(errno));
+        close(gTraceFd);
+        gTraceFd = -1;
+    }
+    pthread_mutex_unlock(&gTraceLock);
+}
+
+void camera_trace_op(int camera_id, int op, nsecs_t start, nsecs_t end,
+        const int32_t *args)
+{
+    camera_trace_record_t record;
+
+    if (gTraceFd < 0)
+        return;
+
+    memset(&record, 0, sizeof(record));
+    record.timestamp = start;
+    record.duration_us = (uint32_t)ns2us(end - start);
+    record.camera_id = camera_id;
+    record.op = op;
+    memcpy(record.args, args, sizeof(record.args));
+    trace_write(&record, NULL, NULL);
+}
+
+void camera_trace_params(int camera_id, int direction, const char *before,
+        const char *after, int32_t result)
+{
+    camera_trace_record_t record;
+
+    if (gTraceFd < 0)
+        return;
+
+    memset(&record, 0, sizeof(record));
+    record.timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    record.camera_id = camera_id;
+    record.op = CAMERA_TRACE_PARAMS;
+    record.args[0] = direction;
+    record.result = result;
+    record.before_len = before ? strlen(before) : 0;
+    if (after && before && !strcmp(before, after))
+        record.after_len = CAMERA_TRACE_SAME_AFTER;
+    else
+        record.after_len = after ? strlen(after) : 0;
+    trace_write(&record, before, after);
+}
+
+void camera_trace_event(int camera_id, int op, int32_t result)
+{
+    camera_trace_record_t record;
+
+    if (gTraceFd < 0)
+        return;
+
+    memset(&record, 0, sizeof(record));
+    record.timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    record.camera_id = camera_id;
+    record.op = op;
+    record.result = result;
+    trace_write(&record, NULL, NULL);
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file CameraTrace.h
+*
+* Binary trace of the ops passing through the camera wrapper, written
+* on the device and read back by the camera_trace_replay host tool.
+*
+*/
+
+#ifndef CAMERA_TRACE_H
+#define CAMERA_TRACE_H
+
+#include <stdint.h>
+#include <utils/Timers.h>
+
+/* every camera_device_ops entry, in struct order; trace files store the index */
+#define CAMERA_DEVICE_OPS(OP) \
+    OP(set_preview_window) \
+    OP(set_callbacks) \
+    OP(enable_msg_type) \
+    OP(disable_msg_type) \
+    OP(msg_type_enabled) \
+    OP(start_preview) \
+    OP(stop_preview) \
+    OP(preview_enabled) \
+    OP(store_meta_data_in_buffers) \
+    OP(start_recording) \
+    OP(stop_recording) \
+    OP(recording_enabled) \
+    OP(release_recording_frame) \
+    OP(auto_focus) \
+    OP(cancel_auto_focus) \
+    OP(take_picture) \
+    OP(cancel_picture) \
+    OP(set_parameters) \
+    OP(get_parameters) \
+    OP(put_parameters) \
+    OP(send_command) \
+    OP(release) \
+    OP(dump)
+
+#define CAMERA_OP_ENUM(op) CAMERA_OP_##op,
+
+enum {
+    CAMERA_DEVICE_OPS(CAMERA_OP_ENUM)
+    CAMERA_OP_COUNT
+};
+
+/* trace records that are not a vendor op */
+enum {
+    /* args[0] is the camera_fixup_direction_t, strings are before/after fixup */
+    CAMERA_TRACE_PARAMS = 0x80,
+    CAMERA_TRACE_OPEN,
+    CAMERA_TRACE_CLOSE,
+};
+
+#define CAMERA_TRACE_MAGIC 0x43575452
+#define CAMERA_TRACE_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} camera_trace_header_t;
+
+/* after is identical to before and not stored */
+#define CAMERA_TRACE_SAME_AFTER 0xffffffff
+
+/*
+ * One record, followed by before_len then after_len bytes of parameter
+ * string (not terminated). Pointer arguments are stored as 0 or 1.
+ */
+typedef struct {
+    int64_t timestamp;
+    /* time spent in the vendor */
+    uint32_t duration_us;
+    uint8_t camera_id;
+    uint8_t op;
+    uint16_t reserved;
+    int32_t args[3];
+    int32_t result;
+    uint32_t before_len;
+    uint32_t after_len;
+} __attribute__((packed)) camera_trace_record_t;
+
+const char *camera_trace_op_name(int op);
+
+/* opens path for writing; without a successful call the others do nothing */
+int camera_trace_start(const char *path);
+void camera_trace_op(int camera_id, int op, nsecs_t start, nsecs_t end,
+        const int32_t *args);
+void camera_trace_params(int camera_id, int direction, const char *before,
+        const char *after, int32_t result);
+void camera_trace_event(int camera_id, int op, int32_t result);
+
+#endif /* CAMERA_TRACE_H */
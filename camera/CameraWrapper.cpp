@@ -24,18 +24,35 @@
 /*
 #define LOG_NDEBUG 0
 #define LOG_PARAMETERS
+#define LOG_PARAMETER_CHANGES
+#define TRACE_PARAMETERS "/data/misc/camera/wrapper_trace"
 */
 #define LOG_TAG "CameraWrapper"
 #include <cutils/log.h>
 
 #include <utils/threads.h>
-#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <cutils/atomic.h>
+#include <cutils/properties.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include <hardware/hardware.h>
 #include <hardware/camera.h>
-#include <camera/Camera.h>
-#include <camera/CameraParameters.h>
 
-static android::Mutex gCameraWrapperLock;
+#include "CameraParameterFixup.h"
+#include "CameraStats.h"
+#include "CameraTrace.h"
+
+#define CAMERA_MAX_CAMERAS 2
+
+/* serializes open and close of each camera id, cameras do not block each other */
+static android::Mutex gCameraOpenLock[CAMERA_MAX_CAMERAS];
+
+/* written once under gVendorModuleOnce, read-only afterwards */
+static pthread_once_t gVendorModuleOnce = PTHREAD_ONCE_INIT;
+static int gVendorModuleStatus;
 static camera_module_t *gVendorModule = 0;
 
 static int camera_device_open(const hw_module_t* module, const char* name,
@@ -64,78 +81,914 @@ camera_module_t HAL_MODULE_INFO_SYM = {
     get_camera_info: camera_get_camera_info,
 };
 
+/*
+ * With CAMERA_ASYNC_OPS, auto focus and picture ops are queued to a per
+ * device worker and return at once, so a slow blob does not hold the
+ * camera service binder thread. Every other op waits for the queue to
+ * drain, which keeps the vendor seeing ops in the order they were issued.
+ */
+#ifdef CAMERA_ASYNC_OPS
+static const int gAsyncOps = 1;
+#else
+static const int gAsyncOps = 0;
+#endif
+
+#define CAMERA_WORKER_QUEUE_SIZE 8
+
+/* set parameters fixed up for the last framework string seen in one mode */
+typedef struct {
+    camera_fixup_arena_t fixed;
+    char *input;
+    size_t input_size;
+    int valid;
+} camera_profile_t;
+
 typedef struct wrapper_camera_device {
     camera_device_t base;
     int id;
     camera_device_t *vendor;
+
+    pthread_mutex_t params_lock;
+    /* fixed-up get parameters, and scratch space for diffing and preparing sets */
+    camera_fixup_arena_t get_arena;
+    camera_fixup_arena_t set_arena;
+    /* switching between still and video reuses these */
+    camera_profile_t profiles[CAMERA_FIXUP_MODES];
+    uint32_t profile_hits;
+    /* get_arena holds the fixup of this raw vendor string */
+    char *cached_vendor_params;
+    size_t cached_vendor_size;
+    size_t cached_vendor_len;
+    uint32_t cached_vendor_hash;
+    int cache_valid;
+    /* get_arena was handed to the framework and not put back yet */
+    int get_arena_lent;
+    uint32_t params_cache_hits;
+    uint32_t params_cache_misses;
+    /* last parameters the vendor accepted, indexed by key */
+    camera_fixup_arena_t applied_params;
+    int applied_params_valid;
+    uint32_t set_params_forwarded;
+    uint32_t set_params_skipped;
+    /* time spent in the vendor for each op */
+    camera_latency_t op_latency[CAMERA_OP_COUNT];
+    /* state as last set through the wrapper, for dump */
+    volatile int32_t msg_types;
+    volatile int32_t previewing;
+    volatile int32_t recording;
+
+    /* framework callbacks, the vendor calls our trampolines instead */
+    camera_notify_callback notify_cb;
+    camera_data_callback data_cb;
+    camera_data_timestamp_callback data_cb_timestamp;
+    camera_request_memory get_memory;
+    void *user;
+    camera_frame_stats_t preview_stats;
+    camera_frame_stats_t recording_stats;
+    camera_buffer_stats_t recording_buffers;
+
+    /* optional worker running the async ops in submission order */
+    int worker_running;
+    pthread_t worker_thread;
+    pthread_mutex_t worker_lock;
+    pthread_cond_t worker_cond;
+    pthread_cond_t worker_idle_cond;
+    int worker_queue[CAMERA_WORKER_QUEUE_SIZE];
+    int worker_head;
+    int worker_count;
+    int worker_exit;
+    /* queued plus running commands */
+    volatile int32_t worker_pending;
 } wrapper_camera_device_t;
 
-#define VENDOR_CALL(device, func, ...) ({ \
+/* open devices by id, so each device's dump can list the others */
+static android::Mutex gOpenDevicesLock;
+static wrapper_camera_device_t *gOpenDevices[CAMERA_MAX_CAMERAS];
+
+/*
+ * Private send_command codes handled by the wrapper and never forwarded
+ * to the vendor.
+ *
+ * CAMERA_CMD_WRAPPER_GET_FRAME_STATS returns one camera_frame_stat_t (arg2)
+ * of the preview (arg1 = 0) or recording (arg1 = 1) stream.
+ *
+ * CAMERA_CMD_WRAPPER_GET_BUFFER_STATS returns one camera_buffer_stat_t
+ * (arg1) of the recording buffers.
+ *
+ * CAMERA_CMD_WRAPPER_PREPARE_VIDEO applies the video profile of the current
+ * parameters to the vendor ahead of the record button, so the vendor
+ * reconfigures now and the framework's own switch to the same parameters
+ * is skipped. arg1 and arg2 are ignored.
+ */
+#define CAMERA_CMD_WRAPPER_BASE 0x43570000
+#define CAMERA_CMD_WRAPPER_GET_FRAME_STATS (CAMERA_CMD_WRAPPER_BASE + 1)
+#define CAMERA_CMD_WRAPPER_GET_BUFFER_STATS (CAMERA_CMD_WRAPPER_BASE + 2)
+#define CAMERA_CMD_WRAPPER_PREPARE_VIDEO (CAMERA_CMD_WRAPPER_BASE + 3)
+
+static inline int32_t camera_trace_arg(int32_t value)
+{
+    return value;
+}
+
+/* pointers only matter to a replay as set or cleared */
+template<typename T> static inline int32_t camera_trace_arg(T *pointer)
+{
+    return pointer != NULL;
+}
+
+/*
+ * Records the lifetime of its scope in the op's latency histogram and,
+ * with TRACE_PARAMETERS, in the trace along with the op's arguments.
+ */
+class VendorCallTimer {
+public:
+    VendorCallTimer(wrapper_camera_device_t *dev, int op)
+        : mDev(dev), mOp(op), mStart(systemTime(SYSTEM_TIME_MONOTONIC)) {
+        mArgs[0] = mArgs[1] = mArgs[2] = 0;
+    }
+    ~VendorCallTimer() {
+        nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        camera_latency_record(&mDev->op_latency[mOp], end - mStart);
+#ifdef TRACE_PARAMETERS
+        camera_trace_op(mDev->id, mOp, mStart, end, mArgs);
+#endif
+    }
+    void args() {}
+    template<typename A> void args(A a) {
+        mArgs[0] = camera_trace_arg(a);
+    }
+    template<typename A, typename B> void args(A a, B b) {
+        mArgs[0] = camera_trace_arg(a);
+        mArgs[1] = camera_trace_arg(b);
+    }
+    template<typename A, typename B, typename C> void args(A a, B b, C c) {
+        mArgs[0] = camera_trace_arg(a);
+        mArgs[1] = camera_trace_arg(b);
+        mArgs[2] = camera_trace_arg(c);
+    }
+    /* set_callbacks, the trace keeps the first three */
+    template<typename A, typename B, typename C, typename D, typename E>
+    void args(A a, B b, C c, D d, E e) {
+        args(a, b, c);
+    }
+private:
+    wrapper_camera_device_t *mDev;
+    int mOp;
+    nsecs_t mStart;
+    int32_t mArgs[3];
+};
+
+/* evaluates the op's arguments a second time, they are all plain values */
+#ifdef TRACE_PARAMETERS
+#define VENDOR_CALL_TRACE_ARGS(timer, ...) timer.args(__VA_ARGS__)
+#else
+#define VENDOR_CALL_TRACE_ARGS(timer, ...) do { } while (0)
+#endif
+
+static void camera_worker_wait_idle(struct wrapper_camera_device *dev);
+
+/* calls into the vendor without waiting for queued async ops */
+#define VENDOR_CALL_UNORDERED(device, func, ...) ({ \
     wrapper_camera_device_t *__wrapper_dev = (wrapper_camera_device_t*) device; \
+    VendorCallTimer __timer(__wrapper_dev, CAMERA_OP_##func); \
+    VENDOR_CALL_TRACE_ARGS(__timer, ##__VA_ARGS__); \
     __wrapper_dev->vendor->ops->func(__wrapper_dev->vendor, ##__VA_ARGS__); \
 })
 
+#define VENDOR_CALL(device, func, ...) ({ \
+    camera_worker_wait_idle((wrapper_camera_device_t*) device); \
+    VENDOR_CALL_UNORDERED(device, func, ##__VA_ARGS__); \
+})
+
 #define CAMERA_ID(device) (((wrapper_camera_device_t *)(device))->id)
 
+static void load_vendor_module()
+{
+    int rv;
+
+    rv = hw_get_module("vendor-camera", (const hw_module_t **)&gVendorModule);
+    if (rv) {
+        LOGE("failed to open vendor camera module");
+        gVendorModule = 0;
+    } else {
+        camera_fixup_init();
+#ifdef TRACE_PARAMETERS
+        camera_trace_start(TRACE_PARAMETERS);
+#endif
+    }
+    gVendorModuleStatus = rv;
+}
+
 static int check_vendor_module()
 {
-    int rv = 0;
     LOGV("%s", __FUNCTION__);
 
-    if(gVendorModule)
-        return 0;
+    pthread_once(&gVendorModuleOnce, load_vendor_module);
+    return gVendorModuleStatus;
+}
 
-    rv = hw_get_module("vendor-camera", (const hw_module_t **)&gVendorModule);
-    if (rv)
-        LOGE("failed to open vendor camera module");
-    return rv;
+/*******************************************************************
+ * static camera information
+ *
+ * camera_info of each camera is snapshotted once and persisted, keyed on
+ * the build fingerprint and the size and mtime of the vendor library, so
+ * a vendor blob swapped without a new build is noticed. With a valid
+ * persisted snapshot the camera service can enumerate the cameras at
+ * boot without loading the vendor module, which is then only loaded on
+ * the first open.
+ *
+ * The supported preview size, picture size and fps range lists are
+ * captured on the first open of each camera, persisted with the rest and
+ * printed by dump. Once captured they do not change.
+ *******************************************************************/
+
+#define CAMERA_STATIC_FILE "/data/misc/camera/wrapper_static"
+#define CAMERA_STATIC_MAGIC 0x43575354
+#define CAMERA_STATIC_VERSION 3
+/* where hw_get_module finds "vendor-camera", by ro.board.platform */
+#define CAMERA_VENDOR_LIBRARY "/system/lib/hw/vendor-camera.%s.so"
+
+typedef struct {
+    struct camera_info info;
+    /* the lists below are only captured on the first open */
+    int lists_valid;
+    char preview_sizes[512];
+    char picture_sizes[512];
+    char fps_ranges[256];
+} camera_static_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    char fingerprint[PROPERTY_VALUE_MAX];
+    int64_t vendor_size;
+    int64_t vendor_mtime;
+    int num_cameras;
+    camera_static_t cameras[CAMERA_MAX_CAMERAS];
+} camera_static_snapshot_t;
+
+static pthread_once_t gStaticOnce = PTHREAD_ONCE_INIT;
+/* the lists and the persisted file, camera_info is fixed once loaded */
+static android::Mutex gStaticLock;
+static camera_static_snapshot_t gStatic;
+
+/* size and mtime of the vendor library, both 0 if it cannot be found */
+static void vendor_library_identity(int64_t *size, int64_t *mtime)
+{
+    char platform[PROPERTY_VALUE_MAX];
+    char path[PATH_MAX];
+    struct stat st;
+
+    property_get("ro.board.platform", platform, "");
+    snprintf(path, sizeof(path), CAMERA_VENDOR_LIBRARY, platform);
+    if (stat(path, &st)) {
+        LOGW("%s: cannot stat %s: %s", __FUNCTION__, path, strerror(errno));
+        *size = *mtime = 0;
+        return;
+    }
+    *size = st.st_size;
+    *mtime = st.st_mtime;
 }
 
-const static char * video_preview_sizes[] = {
-    "1920x1080,1280x720,640x480",
-    "640x480,352x288,320x240,176x144"
-};
+/* called with gStaticLock held */
+static void persist_static_snapshot()
+{
+    const char *tmp = CAMERA_STATIC_FILE ".tmp";
+    int fd, ok;
 
-static char * camera_fixup_getparams(int id, const char * settings)
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0660);
+    if (fd < 0) {
+        LOGW("%s: cannot write %s: %s", __FUNCTION__, tmp, strerror(errno));
+        return;
+    }
+
+    ok = write(fd, &gStatic, sizeof(gStatic)) == sizeof(gStatic) && !fsync(fd);
+    close(fd);
+
+    if (!ok || rename(tmp, CAMERA_STATIC_FILE)) {
+        LOGW("%s: cannot write %s: %s", __FUNCTION__, CAMERA_STATIC_FILE, strerror(errno));
+        unlink(tmp);
+    }
+}
+
+static int read_static_snapshot(const char *fingerprint, int64_t vendor_size,
+        int64_t vendor_mtime)
 {
-    android::CameraParameters params;
-    params.unflatten(android::String8(settings));
+    camera_static_snapshot_t snapshot;
+    int fd, len;
+
+    fd = open(CAMERA_STATIC_FILE, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    len = read(fd, &snapshot, sizeof(snapshot));
+    close(fd);
+
+    if (len != sizeof(snapshot) || snapshot.magic != CAMERA_STATIC_MAGIC ||
+            snapshot.version != CAMERA_STATIC_VERSION ||
+            strncmp(snapshot.fingerprint, fingerprint, sizeof(snapshot.fingerprint)) ||
+            snapshot.vendor_size != vendor_size || snapshot.vendor_mtime != vendor_mtime ||
+            snapshot.num_cameras < 0 || snapshot.num_cameras > CAMERA_MAX_CAMERAS)
+        return -1;
+
+    memcpy(&gStatic, &snapshot, sizeof(gStatic));
+    return 0;
+}
 
-    params.remove(android::CameraParameters::KEY_SUPPORTED_VIDEO_SIZES);
+static void load_static_snapshot()
+{
+    char fingerprint[PROPERTY_VALUE_MAX];
+    int64_t vendor_size, vendor_mtime;
+    int i;
 
-    if(params.get("cam_mode"))
-    {
-        params.set(android::CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES, video_preview_sizes[id]);
-        const char* videoSize = params.get(android::CameraParameters::KEY_VIDEO_SIZE);
-        params.set(android::CameraParameters::KEY_PREVIEW_SIZE, videoSize);
+    property_get("ro.build.fingerprint", fingerprint, "");
+    vendor_library_identity(&vendor_size, &vendor_mtime);
+
+    android::Mutex::Autolock lock(gStaticLock);
+
+    if (!read_static_snapshot(fingerprint, vendor_size, vendor_mtime)) {
+        LOGV("%s: using persisted snapshot", __FUNCTION__);
+        return;
     }
 
-    android::String8 strParams = params.flatten();
-    char *ret = strdup(strParams.string());
+    memset(&gStatic, 0, sizeof(gStatic));
+    if (check_vendor_module())
+        return;
+
+    gStatic.magic = CAMERA_STATIC_MAGIC;
+    gStatic.version = CAMERA_STATIC_VERSION;
+    strncpy(gStatic.fingerprint, fingerprint, sizeof(gStatic.fingerprint) - 1);
+    gStatic.vendor_size = vendor_size;
+    gStatic.vendor_mtime = vendor_mtime;
+    gStatic.num_cameras = gVendorModule->get_number_of_cameras();
+    if (gStatic.num_cameras > CAMERA_MAX_CAMERAS)
+        gStatic.num_cameras = CAMERA_MAX_CAMERAS;
+
+    for (i = 0; i < gStatic.num_cameras; i++) {
+        if (gVendorModule->get_camera_info(i, &gStatic.cameras[i].info)) {
+            LOGE("%s: vendor get_camera_info(%d) failed", __FUNCTION__, i);
+            gStatic.num_cameras = i;
+            break;
+        }
+    }
+
+    persist_static_snapshot();
+}
+
+static const camera_static_snapshot_t *camera_static()
+{
+    pthread_once(&gStaticOnce, load_static_snapshot);
+    return &gStatic;
+}
+
+/*
+ * Captures the supported value lists from the vendor's parameters the
+ * first time a camera is opened.
+ */
+static void camera_static_capture_lists(int id, camera_device_t *vendor)
+{
+    camera_static_t *cam = &gStatic.cameras[id];
+    char *params;
+
+    android::Mutex::Autolock lock(gStaticLock);
+
+    if (cam->lists_valid)
+        return;
+
+    params = vendor->ops->get_parameters(vendor);
+    if (!params)
+        return;
+
+    camera_fixup_get_value(params, "preview-size-values",
+            cam->preview_sizes, sizeof(cam->preview_sizes));
+    camera_fixup_get_value(params, "picture-size-values",
+            cam->picture_sizes, sizeof(cam->picture_sizes));
+    camera_fixup_get_value(params, "preview-fps-range-values",
+            cam->fps_ranges, sizeof(cam->fps_ranges));
+    vendor->ops->put_parameters(vendor, params);
+
+    cam->lists_valid = 1;
+    persist_static_snapshot();
+}
+
+static void camera_dump_static(int fd)
+{
+    const camera_static_snapshot_t *snapshot = camera_static();
+    int i;
+
+    android::Mutex::Autolock lock(gStaticLock);
+
+    for (i = 0; i < snapshot->num_cameras; i++) {
+        const camera_static_t *cam = &snapshot->cameras[i];
+
+        if (!cam->lists_valid)
+            continue;
+        camera_dump_printf(fd, "camera.%d.static.preview_sizes=%s\n", i, cam->preview_sizes);
+        camera_dump_printf(fd, "camera.%d.static.picture_sizes=%s\n", i, cam->picture_sizes);
+        camera_dump_printf(fd, "camera.%d.static.fps_ranges=%s\n", i, cam->fps_ranges);
+    }
+}
+
+/* FNV-1a, also returns the string length so a cache hit needs one pass */
+static uint32_t camera_params_hash(const char *settings, size_t *len)
+{
+    uint32_t hash = 2166136261u;
+    const char *p = settings;
+
+    while (*p) {
+        hash ^= (uint8_t)*p++;
+        hash *= 16777619u;
+    }
+    *len = p - settings;
+    return hash;
+}
+
+static int camera_params_init(wrapper_camera_device_t *dev)
+{
+    int i;
+
+    pthread_mutex_init(&dev->params_lock, NULL);
+    if (camera_fixup_arena_init(&dev->get_arena) ||
+            camera_fixup_arena_init(&dev->set_arena) ||
+            camera_fixup_arena_init(&dev->applied_params))
+        return -ENOMEM;
+    for (i = 0; i < CAMERA_FIXUP_MODES; i++) {
+        if (camera_fixup_arena_init(&dev->profiles[i].fixed))
+            return -ENOMEM;
+    }
+    return 0;
+}
+
+static void camera_params_release(wrapper_camera_device_t *dev)
+{
+    int i;
+
+    LOGD("%s: camera %d parameter cache: %u hits, %u misses", __FUNCTION__,
+            dev->id, dev->params_cache_hits, dev->params_cache_misses);
+    LOGD("%s: camera %d set parameters: %u forwarded, %u skipped", __FUNCTION__,
+            dev->id, dev->set_params_forwarded, dev->set_params_skipped);
+    LOGD("%s: camera %d mode profiles: %u reused", __FUNCTION__,
+            dev->id, dev->profile_hits);
+
+    for (i = 0; i < CAMERA_FIXUP_MODES; i++) {
+        camera_fixup_arena_release(&dev->profiles[i].fixed);
+        free(dev->profiles[i].input);
+        dev->profiles[i].input = NULL;
+    }
+    camera_fixup_arena_release(&dev->get_arena);
+    camera_fixup_arena_release(&dev->set_arena);
+    camera_fixup_arena_release(&dev->applied_params);
+    free(dev->cached_vendor_params);
+    dev->cached_vendor_params = NULL;
+    pthread_mutex_destroy(&dev->params_lock);
+}
+
+/*
+ * Returns the fixed-up parameters for the given vendor string, only running
+ * the fixup when the vendor output changed since the last call.
+ *
+ * The result normally is the device's get_arena itself, which
+ * camera_put_parameters hands back instead of freeing. Should the framework
+ * still hold it, a malloc'ed copy is returned instead.
+ */
+static char * camera_fixup_getparams(wrapper_camera_device_t *dev, const char *settings)
+{
+    size_t len;
+    uint32_t hash;
+    char *ret;
+
+    /* the vendor had no parameters to give */
+    if (!settings)
+        return NULL;
+
+    hash = camera_params_hash(settings, &len);
+    pthread_mutex_lock(&dev->params_lock);
+
+    if (dev->cache_valid && dev->cached_vendor_hash == hash &&
+            dev->cached_vendor_len == len &&
+            !memcmp(dev->cached_vendor_params, settings, len)) {
+        dev->params_cache_hits++;
+        goto lend;
+    }
+
+    dev->params_cache_misses++;
+
+    if (dev->get_arena_lent) {
+        ret = camera_fixup_params(dev->id, CAMERA_FIXUP_GET, settings);
+        pthread_mutex_unlock(&dev->params_lock);
+        LOGD("%s: get parameters fixed up", __FUNCTION__);
+        return ret;
+    }
+
+    dev->cache_valid = 0;
+    if (!camera_fixup_apply(&dev->get_arena, dev->id, CAMERA_FIXUP_GET, settings)) {
+        pthread_mutex_unlock(&dev->params_lock);
+        return NULL;
+    }
+
+    if (len >= dev->cached_vendor_size) {
+        free(dev->cached_vendor_params);
+        dev->cached_vendor_size = len + 1;
+        dev->cached_vendor_params = (char *)malloc(dev->cached_vendor_size);
+        if (!dev->cached_vendor_params)
+            dev->cached_vendor_size = 0;
+    }
+    if (dev->cached_vendor_params) {
+        memcpy(dev->cached_vendor_params, settings, len + 1);
+        dev->cached_vendor_len = len;
+        dev->cached_vendor_hash = hash;
+        dev->cache_valid = 1;
+    }
 
     LOGD("%s: get parameters fixed up", __FUNCTION__);
+
+lend:
+    if (dev->get_arena_lent) {
+        ret = strdup(dev->get_arena.buf);
+    } else {
+        dev->get_arena_lent = 1;
+        ret = dev->get_arena.buf;
+    }
+    pthread_mutex_unlock(&dev->params_lock);
     return ret;
 }
 
-char * camera_fixup_setparams(int id, const char * settings)
+/* returns true when params was the device's get_arena */
+static int camera_return_getparams(wrapper_camera_device_t *dev, char *params)
 {
-    android::CameraParameters params;
-    params.unflatten(android::String8(settings));
+    int ret = 0;
 
-    if(params.get("cam_mode"))
-    {
-        const char* previewSize = params.get(android::CameraParameters::KEY_PREVIEW_SIZE);
-        params.set(android::CameraParameters::KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO, previewSize);
-        params.set(android::CameraParameters::KEY_SUPPORTED_VIDEO_SIZES, video_preview_sizes[id]);
+    pthread_mutex_lock(&dev->params_lock);
+    if (dev->get_arena_lent && params == dev->get_arena.buf) {
+        dev->get_arena_lent = 0;
+        ret = 1;
     }
+    pthread_mutex_unlock(&dev->params_lock);
+    return ret;
+}
 
-    android::String8 strParams = params.flatten();
-    char *ret = strdup(strParams.string());
+#ifdef LOG_PARAMETER_CHANGES
+static void camera_log_changed_param(const char *key, size_t key_len, void *cookie)
+{
+    LOGI("camera %d: parameter %.*s changed", ((wrapper_camera_device_t *)cookie)->id,
+            (int)key_len, key);
+}
+#else
+#define camera_log_changed_param NULL
+#endif
 
-    LOGD("%s: set parameters fixed up", __FUNCTION__);
+/*
+ * Returns 0 when the fixed-up parameters match what the vendor last
+ * accepted, so the set can be skipped, or the number of changed keys.
+ * Called with params_lock held.
+ */
+static int camera_params_changed(wrapper_camera_device_t *dev, const char *fixed)
+{
+    int changed;
+
+    if (!dev->applied_params_valid)
+        return -1;
+    if (!strcmp(dev->applied_params.buf, fixed))
+        return 0;
+
+    changed = camera_fixup_diff(&dev->set_arena, &dev->applied_params, fixed,
+            camera_log_changed_param, dev);
+    LOGV("%s: %d keys changed", __FUNCTION__, changed);
+    return changed;
+}
+
+/* called with params_lock held */
+static void camera_params_applied(wrapper_camera_device_t *dev, const char *fixed, int ret)
+{
+    dev->applied_params_valid = !ret && !camera_fixup_snapshot(&dev->applied_params, fixed);
+}
+
+/*
+ * Returns the fixed-up set parameters for settings. The last input of
+ * each mode is remembered with its fixup, so toggling cam_mode back and
+ * forth does not run the fixup again. Called with params_lock held.
+ */
+static const char * camera_fixup_setparams(wrapper_camera_device_t *dev, const char *settings)
+{
+    camera_profile_t *profile = &dev->profiles[camera_fixup_get_mode(settings)];
+    size_t len;
+    const char *fixed;
+
+    /* a plain compare, hashing a whole parameter string costs more */
+    if (profile->valid && !strcmp(profile->input, settings)) {
+        dev->profile_hits++;
+        return profile->fixed.buf;
+    }
+
+    profile->valid = 0;
+    fixed = camera_fixup_apply(&profile->fixed, dev->id, CAMERA_FIXUP_SET, settings);
+    if (!fixed)
+        return NULL;
+
+    len = strlen(settings);
+    if (len >= profile->input_size) {
+        free(profile->input);
+        profile->input_size = len + 1;
+        profile->input = (char *)malloc(profile->input_size);
+        if (!profile->input)
+            profile->input_size = 0;
+    }
+    if (profile->input) {
+        memcpy(profile->input, settings, len + 1);
+        profile->valid = 1;
+    }
+    return fixed;
+}
+
+/*
+ * Builds the video profile of the parameters the vendor last accepted and
+ * optionally applies it. The profile's arena is reused for the result, so
+ * its remembered input no longer matches it.
+ */
+static int camera_params_prepare_video(wrapper_camera_device_t *dev)
+{
+    const char *fixed;
+    int ret = 0;
+
+    /* see camera_set_parameters */
+    camera_worker_wait_idle(dev);
+    pthread_mutex_lock(&dev->params_lock);
+
+    if (!dev->applied_params_valid) {
+        pthread_mutex_unlock(&dev->params_lock);
+        return -ENODATA;
+    }
+
+    /* built in the scratch arena, the cached video profile stays valid */
+    fixed = camera_fixup_apply_profile(&dev->set_arena, dev->id,
+            CAMERA_FIXUP_MODE_VIDEO, dev->applied_params.buf);
+    if (!fixed) {
+        pthread_mutex_unlock(&dev->params_lock);
+        return -ENOMEM;
+    }
+
+    if (camera_params_changed(dev, fixed)) {
+        ret = VENDOR_CALL_UNORDERED(dev, set_parameters, fixed);
+        dev->set_params_forwarded++;
+        camera_params_applied(dev, fixed, ret);
+        LOGI("camera %d: video profile applied ahead of recording (%d)", dev->id, ret);
+    }
+
+    pthread_mutex_unlock(&dev->params_lock);
     return ret;
 }
 
+/*
+ * Commands such as smooth zoom change the vendor's parameters behind our
+ * back, so the next set has to be forwarded even if it looks unchanged.
+ */
+static void camera_params_invalidate(wrapper_camera_device_t *dev)
+{
+    pthread_mutex_lock(&dev->params_lock);
+    dev->applied_params_valid = 0;
+    pthread_mutex_unlock(&dev->params_lock);
+}
+
+/*******************************************************************
+ * callback trampolines, user is always our wrapper_camera_device_t
+ *******************************************************************/
+
+/*
+ * Set while a thread runs one of the framework's callbacks. The camera
+ * service calls ops such as disable_msg_type from inside its callbacks,
+ * and those must not wait for an async op that may be what triggered
+ * the callback.
+ */
+static pthread_key_t gInCallbackKey;
+static pthread_once_t gInCallbackKeyOnce = PTHREAD_ONCE_INIT;
+
+static void camera_in_callback_key_init(void)
+{
+    pthread_key_create(&gInCallbackKey, NULL);
+}
+
+class CallbackScope {
+public:
+    CallbackScope() : mOuter(pthread_getspecific(gInCallbackKey)) {
+        pthread_setspecific(gInCallbackKey, this);
+    }
+    ~CallbackScope() {
+        pthread_setspecific(gInCallbackKey, mOuter);
+    }
+private:
+    void *mOuter;
+};
+
+static void camera_notify_trampoline(int32_t msg_type, int32_t ext1,
+        int32_t ext2, void *user)
+{
+    wrapper_camera_device_t *dev = (wrapper_camera_device_t *)user;
+    CallbackScope scope;
+
+    dev->notify_cb(msg_type, ext1, ext2, dev->user);
+}
+
+static void camera_data_trampoline(int32_t msg_type, const camera_memory_t *data,
+        unsigned int index, camera_frame_metadata_t *metadata, void *user)
+{
+    wrapper_camera_device_t *dev = (wrapper_camera_device_t *)user;
+    CallbackScope scope;
+
+    if (msg_type & CAMERA_MSG_PREVIEW_FRAME) {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        camera_frame_stats_record(&dev->preview_stats, now);
+        dev->data_cb(msg_type, data, index, metadata, dev->user);
+        camera_latency_record(&dev->preview_stats.callback_latency,
+                systemTime(SYSTEM_TIME_MONOTONIC) - now);
+        return;
+    }
+
+    dev->data_cb(msg_type, data, index, metadata, dev->user);
+}
+
+static void camera_data_timestamp_trampoline(int64_t timestamp, int32_t msg_type,
+        const camera_memory_t *data, unsigned int index, void *user)
+{
+    wrapper_camera_device_t *dev = (wrapper_camera_device_t *)user;
+    CallbackScope scope;
+
+    if (msg_type & CAMERA_MSG_VIDEO_FRAME) {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        camera_frame_stats_record(&dev->recording_stats, timestamp);
+        camera_buffer_stats_deliver(&dev->recording_buffers, dev->id, data, index, now);
+        dev->data_cb_timestamp(timestamp, msg_type, data, index, dev->user);
+        camera_latency_record(&dev->recording_stats.callback_latency,
+                systemTime(SYSTEM_TIME_MONOTONIC) - now);
+        return;
+    }
+
+    dev->data_cb_timestamp(timestamp, msg_type, data, index, dev->user);
+}
+
+static camera_memory_t *camera_get_memory_trampoline(int fd, size_t buf_size,
+        unsigned int num_bufs, void *user)
+{
+    wrapper_camera_device_t *dev = (wrapper_camera_device_t *)user;
+    camera_memory_t *mem;
+
+    mem = dev->get_memory(fd, buf_size, num_bufs, dev->user);
+    /* remembered to map released recording frames back to their buffer */
+    camera_buffer_stats_memory(&dev->recording_buffers, mem, buf_size, num_bufs);
+    return mem;
+}
+
+/*******************************************************************
+ * async op worker
+ *******************************************************************/
+
+static void camera_worker_run(wrapper_camera_device_t *dev, int op)
+{
+    int ret = 0;
+
+    switch (op) {
+    case CAMERA_OP_auto_focus:
+        ret = VENDOR_CALL_UNORDERED(dev, auto_focus);
+        /* report the failed focus the framework is waiting for */
+        if (ret && dev->notify_cb)
+            camera_notify_trampoline(CAMERA_MSG_FOCUS, 0, 0, dev);
+        break;
+    case CAMERA_OP_cancel_auto_focus:
+        ret = VENDOR_CALL_UNORDERED(dev, cancel_auto_focus);
+        break;
+    case CAMERA_OP_take_picture:
+        ret = VENDOR_CALL_UNORDERED(dev, take_picture);
+        if (ret && dev->notify_cb)
+            camera_notify_trampoline(CAMERA_MSG_ERROR, CAMERA_ERROR_UNKNOWN, 0, dev);
+        break;
+    case CAMERA_OP_cancel_picture:
+        ret = VENDOR_CALL_UNORDERED(dev, cancel_picture);
+        break;
+    }
+
+    if (ret)
+        LOGE("%s: camera %d %s failed: %d", __FUNCTION__, dev->id,
+                camera_trace_op_name(op), ret);
+}
+
+static void *camera_worker_thread(void *arg)
+{
+    wrapper_camera_device_t *dev = (wrapper_camera_device_t *)arg;
+
+    pthread_mutex_lock(&dev->worker_lock);
+    for (;;) {
+        while (!dev->worker_count && !dev->worker_exit)
+            pthread_cond_wait(&dev->worker_cond, &dev->worker_lock);
+        if (!dev->worker_count)
+            break;
+
+        int op = dev->worker_queue[dev->worker_head];
+        dev->worker_head = (dev->worker_head + 1) % CAMERA_WORKER_QUEUE_SIZE;
+        dev->worker_count--;
+        /* wake a submitter waiting for a free slot */
+        pthread_cond_broadcast(&dev->worker_idle_cond);
+        pthread_mutex_unlock(&dev->worker_lock);
+
+        camera_worker_run(dev, op);
+
+        pthread_mutex_lock(&dev->worker_lock);
+        android_atomic_dec(&dev->worker_pending);
+        pthread_cond_broadcast(&dev->worker_idle_cond);
+    }
+    pthread_mutex_unlock(&dev->worker_lock);
+
+    return NULL;
+}
+
+static void camera_worker_start(wrapper_camera_device_t *dev)
+{
+    pthread_mutex_init(&dev->worker_lock, NULL);
+    pthread_cond_init(&dev->worker_cond, NULL);
+    pthread_cond_init(&dev->worker_idle_cond, NULL);
+
+    if (!gAsyncOps)
+        return;
+
+    if (pthread_create(&dev->worker_thread, NULL, camera_worker_thread, dev)) {
+        LOGE("%s: camera %d worker thread creation failed, ops stay synchronous",
+                __FUNCTION__, dev->id);
+        return;
+    }
+    dev->worker_running = 1;
+}
+
+/* runs the remaining queued ops, then stops the worker */
+static void camera_worker_stop(wrapper_camera_device_t *dev)
+{
+    if (dev->worker_running) {
+        pthread_mutex_lock(&dev->worker_lock);
+        dev->worker_exit = 1;
+        pthread_cond_signal(&dev->worker_cond);
+        pthread_mutex_unlock(&dev->worker_lock);
+
+        pthread_join(dev->worker_thread, NULL);
+        dev->worker_running = 0;
+    }
+
+    pthread_cond_destroy(&dev->worker_idle_cond);
+    pthread_cond_destroy(&dev->worker_cond);
+    pthread_mutex_destroy(&dev->worker_lock);
+}
+
+/* returns -1 when there is no worker and the caller has to run op itself */
+static int camera_worker_submit(wrapper_camera_device_t *dev, int op)
+{
+    if (!dev->worker_running)
+        return -1;
+
+    pthread_mutex_lock(&dev->worker_lock);
+    while (dev->worker_count == CAMERA_WORKER_QUEUE_SIZE)
+        pthread_cond_wait(&dev->worker_idle_cond, &dev->worker_lock);
+
+    dev->worker_queue[(dev->worker_head + dev->worker_count) % CAMERA_WORKER_QUEUE_SIZE] = op;
+    dev->worker_count++;
+    android_atomic_inc(&dev->worker_pending);
+    pthread_cond_signal(&dev->worker_cond);
+    pthread_mutex_unlock(&dev->worker_lock);
+
+    return 0;
+}
+
+static void camera_worker_wait_idle(wrapper_camera_device_t *dev)
+{
+    if (!dev->worker_running || !dev->worker_pending)
+        return;
+
+    /* ops issued by the worker itself or from inside callbacks run at once */
+    if (pthread_equal(pthread_self(), dev->worker_thread) ||
+            pthread_getspecific(gInCallbackKey))
+        return;
+
+    pthread_mutex_lock(&dev->worker_lock);
+    while (dev->worker_pending)
+        pthread_cond_wait(&dev->worker_idle_cond, &dev->worker_lock);
+    pthread_mutex_unlock(&dev->worker_lock);
+}
+
+static int camera_wrapper_command(wrapper_camera_device_t *dev, int32_t cmd,
+        int32_t arg1, int32_t arg2)
+{
+    camera_frame_stats_t *stats;
+
+    switch (cmd) {
+    case CAMERA_CMD_WRAPPER_GET_FRAME_STATS:
+        stats = arg1 ? &dev->recording_stats : &dev->preview_stats;
+        return camera_frame_stats_get(stats, (camera_frame_stat_t)arg2);
+    case CAMERA_CMD_WRAPPER_GET_BUFFER_STATS:
+        return camera_buffer_stats_get(&dev->recording_buffers, (camera_buffer_stat_t)arg1);
+    case CAMERA_CMD_WRAPPER_PREPARE_VIDEO:
+        return camera_params_prepare_video(dev);
+    }
+
+    return -EINVAL;
+}
+
 /*******************************************************************
  * implementation of camera_device_ops functions
  *******************************************************************/
@@ -164,7 +1017,20 @@ void camera_set_callbacks(struct camera_device * device,
     if(!device)
         return;
 
-    VENDOR_CALL(device, set_callbacks, notify_cb, data_cb, data_cb_timestamp, get_memory, user);
+    wrapper_camera_device_t *dev = (wrapper_camera_device_t*) device;
+
+    dev->notify_cb = notify_cb;
+    dev->data_cb = data_cb;
+    dev->data_cb_timestamp = data_cb_timestamp;
+    dev->get_memory = get_memory;
+    dev->user = user;
+
+    VENDOR_CALL(device, set_callbacks,
+            notify_cb ? camera_notify_trampoline : NULL,
+            data_cb ? camera_data_trampoline : NULL,
+            data_cb_timestamp ? camera_data_timestamp_trampoline : NULL,
+            get_memory ? camera_get_memory_trampoline : NULL,
+            dev);
 }
 
 void camera_enable_msg_type(struct camera_device * device, int32_t msg_type)
@@ -176,6 +1042,7 @@ void camera_enable_msg_type(struct camera_device * device, int32_t msg_type)
         return;
 
     VENDOR_CALL(device, enable_msg_type, msg_type);
+    android_atomic_or(msg_type, &((wrapper_camera_device_t*)device)->msg_types);
 }
 
 void camera_disable_msg_type(struct camera_device * device, int32_t msg_type)
@@ -187,6 +1054,7 @@ void camera_disable_msg_type(struct camera_device * device, int32_t msg_type)
         return;
 
     VENDOR_CALL(device, disable_msg_type, msg_type);
+    android_atomic_and(~msg_type, &((wrapper_camera_device_t*)device)->msg_types);
 }
 
 int camera_msg_type_enabled(struct camera_device * device, int32_t msg_type)
@@ -202,13 +1070,19 @@ int camera_msg_type_enabled(struct camera_device * device, int32_t msg_type)
 
 int camera_start_preview(struct camera_device * device)
 {
+    int ret;
+
     LOGV("%s", __FUNCTION__);
     LOGV("%s->%08X->%08X", __FUNCTION__, (uintptr_t)device, (uintptr_t)(((wrapper_camera_device_t*)device)->vendor));
 
     if(!device)
         return -EINVAL;
 
-    return VENDOR_CALL(device, start_preview);
+    camera_frame_stats_reset(&((wrapper_camera_device_t*)device)->preview_stats);
+
+    ret = VENDOR_CALL(device, start_preview);
+    ((wrapper_camera_device_t*)device)->previewing = !ret;
+    return ret;
 }
 
 void camera_stop_preview(struct camera_device * device)
@@ -220,6 +1094,7 @@ void camera_stop_preview(struct camera_device * device)
         return;
 
     VENDOR_CALL(device, stop_preview);
+    ((wrapper_camera_device_t*)device)->previewing = 0;
 }
 
 int camera_preview_enabled(struct camera_device * device)
@@ -235,24 +1110,39 @@ int camera_preview_enabled(struct camera_device * device)
 
 int camera_store_meta_data_in_buffers(struct camera_device * device, int enable)
 {
+    wrapper_camera_device_t *dev = (wrapper_camera_device_t*) device;
+    int ret;
+
     LOGV("%s", __FUNCTION__);
     LOGV("%s->%08X->%08X", __FUNCTION__, (uintptr_t)device, (uintptr_t)(((wrapper_camera_device_t*)device)->vendor));
 
     if(!device)
         return -EINVAL;
 
-    return VENDOR_CALL(device, store_meta_data_in_buffers, enable);
+    ret = VENDOR_CALL(device, store_meta_data_in_buffers, enable);
+    LOGI("camera %d: metadata mode %s%s", dev->id, enable ? "on" : "off",
+            ret ? " refused by vendor" : "");
+    if (!ret)
+        camera_buffer_stats_metadata_mode(&dev->recording_buffers, enable);
+    return ret;
 }
 
 int camera_start_recording(struct camera_device * device)
 {
+    int ret;
+
     LOGV("%s", __FUNCTION__);
     LOGV("%s->%08X->%08X", __FUNCTION__, (uintptr_t)device, (uintptr_t)(((wrapper_camera_device_t*)device)->vendor));
 
     if(!device)
         return EINVAL;
 
-    return VENDOR_CALL(device, start_recording);
+    camera_frame_stats_reset(&((wrapper_camera_device_t*)device)->recording_stats);
+    camera_buffer_stats_reset(&((wrapper_camera_device_t*)device)->recording_buffers);
+
+    ret = VENDOR_CALL(device, start_recording);
+    ((wrapper_camera_device_t*)device)->recording = !ret;
+    return ret;
 }
 
 void camera_stop_recording(struct camera_device * device)
@@ -263,8 +1153,8 @@ void camera_stop_recording(struct camera_device * device)
     if(!device)
         return;
 
-
     VENDOR_CALL(device, stop_recording);
+    ((wrapper_camera_device_t*)device)->recording = 0;
 }
 
 int camera_recording_enabled(struct camera_device * device)
@@ -287,6 +1177,9 @@ void camera_release_recording_frame(struct camera_device * device,
     if(!device)
         return;
 
+    camera_buffer_stats_release(&((wrapper_camera_device_t*)device)->recording_buffers,
+            opaque, systemTime(SYSTEM_TIME_MONOTONIC));
+
     VENDOR_CALL(device, release_recording_frame, opaque);
 }
 
@@ -299,6 +1192,9 @@ int camera_auto_focus(struct camera_device * device)
         return -EINVAL;
 
 
+    if (!camera_worker_submit((wrapper_camera_device_t*)device, CAMERA_OP_auto_focus))
+        return 0;
+
     return VENDOR_CALL(device, auto_focus);
 }
 
@@ -311,6 +1207,9 @@ int camera_cancel_auto_focus(struct camera_device * device)
         return -EINVAL;
 
 
+    if (!camera_worker_submit((wrapper_camera_device_t*)device, CAMERA_OP_cancel_auto_focus))
+        return 0;
+
     return VENDOR_CALL(device, cancel_auto_focus);
 }
 
@@ -322,6 +1221,9 @@ int camera_take_picture(struct camera_device * device)
     if(!device)
         return -EINVAL;
 
+    if (!camera_worker_submit((wrapper_camera_device_t*)device, CAMERA_OP_take_picture))
+        return 0;
+
     return VENDOR_CALL(device, take_picture);
 }
 
@@ -333,7 +1235,10 @@ int camera_cancel_picture(struct camera_device * device)
     if(!device)
         return -EINVAL;
 
-    return VENDOR_CALL(device, take_picture);
+    if (!camera_worker_submit((wrapper_camera_device_t*)device, CAMERA_OP_cancel_picture))
+        return 0;
+
+    return VENDOR_CALL(device, cancel_picture);
 }
 
 int camera_set_parameters(struct camera_device * device, const char *params)
@@ -344,14 +1249,45 @@ int camera_set_parameters(struct camera_device * device, const char *params)
     if(!device)
         return -EINVAL;
 
-    char *tmp = NULL;
-    tmp = camera_fixup_setparams(CAMERA_ID(device), params);
+    wrapper_camera_device_t *dev = (wrapper_camera_device_t*) device;
+    int ret;
+
+    /*
+     * Queued async ops run before the set, but are waited for before
+     * params_lock is taken: their vendor callbacks may call back into
+     * get_parameters, which needs the lock.
+     */
+    camera_worker_wait_idle(dev);
+    pthread_mutex_lock(&dev->params_lock);
+
+    const char *tmp = camera_fixup_setparams(dev, params);
+    if (!tmp) {
+        pthread_mutex_unlock(&dev->params_lock);
+        return -ENOMEM;
+    }
+    LOGD("%s: set parameters fixed up", __FUNCTION__);
+
+    if (!camera_params_changed(dev, tmp)) {
+        dev->set_params_skipped++;
+#ifdef TRACE_PARAMETERS
+        camera_trace_params(dev->id, CAMERA_FIXUP_SET, params, tmp, 0);
+#endif
+        pthread_mutex_unlock(&dev->params_lock);
+        return 0;
+    }
 
 #ifdef LOG_PARAMETERS
     __android_log_write(ANDROID_LOG_VERBOSE, LOG_TAG, tmp);
 #endif
 
-    int ret = VENDOR_CALL(device, set_parameters, tmp);
+    ret = VENDOR_CALL_UNORDERED(device, set_parameters, tmp);
+    dev->set_params_forwarded++;
+    camera_params_applied(dev, tmp, ret);
+    /* after the vendor's op record, so a replay takes its delay first */
+#ifdef TRACE_PARAMETERS
+    camera_trace_params(dev->id, CAMERA_FIXUP_SET, params, tmp, ret);
+#endif
+    pthread_mutex_unlock(&dev->params_lock);
     return ret;
 }
 
@@ -369,8 +1305,13 @@ char* camera_get_parameters(struct camera_device * device)
     __android_log_write(ANDROID_LOG_VERBOSE, LOG_TAG, params);
 #endif
 
-    char * tmp = camera_fixup_getparams(CAMERA_ID(device), params);
-    VENDOR_CALL(device, put_parameters, params);
+    char * tmp = camera_fixup_getparams((wrapper_camera_device_t*)device, params);
+#ifdef TRACE_PARAMETERS
+    camera_trace_params(CAMERA_ID(device), CAMERA_FIXUP_GET, params, tmp,
+            params ? (tmp ? 0 : -ENOMEM) : -ENODATA);
+#endif
+    if (params)
+        VENDOR_CALL(device, put_parameters, params);
     params = tmp;
 
 #ifdef LOG_PARAMETERS
@@ -385,6 +1326,9 @@ static void camera_put_parameters(struct camera_device *device, char *params)
     LOGV("%s", __FUNCTION__);
     LOGV("%s->%08X->%08X", __FUNCTION__, (uintptr_t)device, (uintptr_t)(((wrapper_camera_device_t*)device)->vendor));
 
+    if(device && camera_return_getparams((wrapper_camera_device_t*)device, params))
+        return;
+
     if(params)
         free(params);
 }
@@ -398,6 +1342,11 @@ int camera_send_command(struct camera_device * device,
     if(!device)
         return -EINVAL;
 
+    if ((cmd & 0xffff0000) == CAMERA_CMD_WRAPPER_BASE)
+        return camera_wrapper_command((wrapper_camera_device_t*)device, cmd, arg1, arg2);
+
+    camera_params_invalidate((wrapper_camera_device_t*)device);
+
     return VENDOR_CALL(device, send_command, cmd, arg1, arg2);
 }
 
@@ -412,12 +1361,91 @@ void camera_release(struct camera_device * device)
     VENDOR_CALL(device, release);
 }
 
+/* what the framework last asked of an open device, cheap enough for any device */
+static void camera_dump_state(int fd, wrapper_camera_device_t *dev)
+{
+    camera_dump_printf(fd, "camera.%d.msg_types=0x%x\n", dev->id, dev->msg_types);
+    camera_dump_printf(fd, "camera.%d.preview_enabled=%d\n", dev->id, dev->previewing);
+    camera_dump_printf(fd, "camera.%d.recording_enabled=%d\n", dev->id, dev->recording);
+}
+
+static void camera_dump_stats(int fd, wrapper_camera_device_t *dev)
+{
+    char prefix[CAMERA_DUMP_PREFIX_MAX];
+    uint32_t hits, misses, forwarded, skipped, profile_hits;
+    int i;
+
+    pthread_mutex_lock(&dev->params_lock);
+    hits = dev->params_cache_hits;
+    misses = dev->params_cache_misses;
+    forwarded = dev->set_params_forwarded;
+    skipped = dev->set_params_skipped;
+    profile_hits = dev->profile_hits;
+    pthread_mutex_unlock(&dev->params_lock);
+
+    camera_dump_printf(fd, "camera.%d.params.get_cache_hits=%u\n", dev->id, hits);
+    camera_dump_printf(fd, "camera.%d.params.get_cache_misses=%u\n", dev->id, misses);
+    camera_dump_printf(fd, "camera.%d.params.get_cache_hit_pct=%u\n", dev->id,
+            hits + misses ? (uint32_t)((uint64_t)hits * 100 / (hits + misses)) : 0);
+    camera_dump_printf(fd, "camera.%d.params.set_forwarded=%u\n", dev->id, forwarded);
+    camera_dump_printf(fd, "camera.%d.params.set_skipped=%u\n", dev->id, skipped);
+    camera_dump_printf(fd, "camera.%d.params.profile_hits=%u\n", dev->id, profile_hits);
+
+    for (i = 0; i < CAMERA_OP_COUNT; i++) {
+        snprintf(prefix, sizeof(prefix), "camera.%d.op.%s", dev->id, camera_trace_op_name(i));
+        camera_latency_dump(fd, prefix, &dev->op_latency[i]);
+    }
+
+    snprintf(prefix, sizeof(prefix), "camera.%d.preview", dev->id);
+    camera_frame_stats_dump(fd, prefix, &dev->preview_stats);
+    snprintf(prefix, sizeof(prefix), "camera.%d.recording", dev->id);
+    camera_frame_stats_dump(fd, prefix, &dev->recording_stats);
+    snprintf(prefix, sizeof(prefix), "camera.%d.recording_buffers", dev->id);
+    camera_buffer_stats_dump(fd, prefix, &dev->recording_buffers);
+}
+
+/*
+ * Prints the wrapper's state as key=value lines: the open devices with
+ * their msg types and preview/recording flags, then the parameter, op
+ * latency and frame statistics of this device, then the vendor's dump.
+ */
 int camera_dump(struct camera_device * device, int fd)
 {
+    wrapper_camera_device_t *dev = (wrapper_camera_device_t*) device;
+    char open_ids[CAMERA_MAX_CAMERAS * 4];
+    size_t len = 0;
+    int i, ret;
+
     if(!device)
         return -EINVAL;
 
-    return VENDOR_CALL(device, dump, fd);
+    camera_dump_printf(fd, "camera_wrapper.dump_version=1\n");
+    camera_dump_printf(fd, "camera_wrapper.dumping=%d\n", dev->id);
+
+    {
+        android::Mutex::Autolock lock(gOpenDevicesLock);
+
+        open_ids[0] = '\0';
+        for (i = 0; i < CAMERA_MAX_CAMERAS; i++) {
+            if (gOpenDevices[i])
+                len += snprintf(open_ids + len, sizeof(open_ids) - len, "%s%d",
+                        len ? "," : "", i);
+        }
+        camera_dump_printf(fd, "camera_wrapper.open=%s\n", open_ids);
+
+        for (i = 0; i < CAMERA_MAX_CAMERAS; i++) {
+            if (gOpenDevices[i])
+                camera_dump_state(fd, gOpenDevices[i]);
+        }
+    }
+
+    camera_dump_static(fd);
+    camera_dump_stats(fd, dev);
+
+    camera_dump_printf(fd, "camera.%d.vendor_dump=begin\n", dev->id);
+    ret = VENDOR_CALL(device, dump, fd);
+    camera_dump_printf(fd, "camera.%d.vendor_dump=end\n", dev->id);
+    return ret;
 }
 
 extern "C" void heaptracker_free_leaked_memory(void);
@@ -425,23 +1453,38 @@ extern "C" void heaptracker_free_leaked_memory(void);
 int camera_device_close(hw_device_t* device)
 {
     int ret = 0;
+    int id;
     wrapper_camera_device_t *wrapper_dev = NULL;
 
     LOGV("%s", __FUNCTION__);
 
-    android::Mutex::Autolock lock(gCameraWrapperLock);
-
     if (!device) {
         ret = -EINVAL;
         goto done;
     }
 
     wrapper_dev = (wrapper_camera_device_t*) device;
+    id = wrapper_dev->id;
 
+    gCameraOpenLock[id].lock();
+#ifdef TRACE_PARAMETERS
+    camera_trace_event(id, CAMERA_TRACE_CLOSE, 0);
+#endif
+
+    gOpenDevicesLock.lock();
+    gOpenDevices[id] = NULL;
+    gOpenDevicesLock.unlock();
+
+    camera_worker_stop(wrapper_dev);
     wrapper_dev->vendor->common.close((hw_device_t*)wrapper_dev->vendor);
+    camera_params_release(wrapper_dev);
+    camera_frame_stats_destroy(&wrapper_dev->preview_stats);
+    camera_frame_stats_destroy(&wrapper_dev->recording_stats);
+    camera_buffer_stats_destroy(&wrapper_dev->recording_buffers);
     if (wrapper_dev->base.ops)
         free(wrapper_dev->base.ops);
     free(wrapper_dev);
+    gCameraOpenLock[id].unlock();
 done:
 #ifdef HEAPTRACKER
     heaptracker_free_leaked_memory();
@@ -468,18 +1511,18 @@ int camera_device_open(const hw_module_t* module, const char* name,
     wrapper_camera_device_t* camera_device = NULL;
     camera_device_ops_t* camera_ops = NULL;
 
-    android::Mutex::Autolock lock(gCameraWrapperLock);
-
     LOGV("camera_device open");
 
+    pthread_once(&gInCallbackKeyOnce, camera_in_callback_key_init);
+
     if (name != NULL) {
         if (check_vendor_module())
             return -EINVAL;
 
         cameraid = atoi(name);
-        num_cameras = gVendorModule->get_number_of_cameras();
+        num_cameras = camera_static()->num_cameras;
 
-        if(cameraid > num_cameras)
+        if(cameraid < 0 || cameraid >= num_cameras || cameraid >= CAMERA_MAX_CAMERAS)
         {
             LOGE("camera service provided cameraid out of bounds, "
                     "cameraid = %d, num supported = %d",
@@ -488,6 +1531,9 @@ int camera_device_open(const hw_module_t* module, const char* name,
             goto fail;
         }
 
+        /* only this camera id is locked, the other one can open meanwhile */
+        android::Mutex::Autolock lock(gCameraOpenLock[cameraid]);
+
         camera_device = (wrapper_camera_device_t*)malloc(sizeof(*camera_device));
         if(!camera_device)
         {
@@ -497,6 +1543,16 @@ int camera_device_open(const hw_module_t* module, const char* name,
         }
         memset(camera_device, 0, sizeof(*camera_device));
         camera_device->id = cameraid;
+        camera_frame_stats_init(&camera_device->preview_stats);
+        camera_frame_stats_init(&camera_device->recording_stats);
+        camera_buffer_stats_init(&camera_device->recording_buffers);
+
+        if(camera_params_init(camera_device))
+        {
+            LOGE("camera parameter arena allocation fail");
+            rv = -ENOMEM;
+            goto fail;
+        }
 
         if(rv = gVendorModule->common.methods->open((const hw_module_t*)gVendorModule, name, (hw_device_t**)&(camera_device->vendor)))
         {
@@ -505,6 +1561,8 @@ int camera_device_open(const hw_module_t* module, const char* name,
         }
         LOGV("%s: got vendor camera device 0x%08X", __FUNCTION__, (uintptr_t)(camera_device->vendor));
 
+        camera_static_capture_lists(cameraid, camera_device->vendor);
+
         camera_ops = (camera_device_ops_t*)malloc(sizeof(*camera_ops));
         if(!camera_ops)
         {
@@ -545,6 +1603,15 @@ int camera_device_open(const hw_module_t* module, const char* name,
         camera_ops->release = camera_release;
         camera_ops->dump = camera_dump;
 
+        camera_worker_start(camera_device);
+
+        gOpenDevicesLock.lock();
+        gOpenDevices[cameraid] = camera_device;
+        gOpenDevicesLock.unlock();
+#ifdef TRACE_PARAMETERS
+        camera_trace_event(cameraid, CAMERA_TRACE_OPEN, 0);
+#endif
+
         *device = &camera_device->base.common;
     }
 
@@ -552,6 +1619,10 @@ int camera_device_open(const hw_module_t* module, const char* name,
 
 fail:
     if(camera_device) {
+        camera_params_release(camera_device);
+        camera_frame_stats_destroy(&camera_device->preview_stats);
+        camera_frame_stats_destroy(&camera_device->recording_stats);
+        camera_buffer_stats_destroy(&camera_device->recording_buffers);
         free(camera_device);
         camera_device = NULL;
     }
@@ -566,15 +1637,17 @@ fail:
 int camera_get_number_of_cameras(void)
 {
     LOGV("%s", __FUNCTION__);
-    if (check_vendor_module())
-        return 0;
-    return gVendorModule->get_number_of_cameras();
+    return camera_static()->num_cameras;
 }
 
+/* served from the static snapshot, without locking or calling the vendor */
 int camera_get_camera_info(int camera_id, struct camera_info *info)
 {
+    const camera_static_snapshot_t *snapshot = camera_static();
+
     LOGV("%s", __FUNCTION__);
-    if (check_vendor_module())
-        return 0;
-    return gVendorModule->get_camera_info(camera_id, info);
+    if (camera_id < 0 || camera_id >= snapshot->num_cameras)
+        return -EINVAL;
+    *info = snapshot->cameras[camera_id].info;
+    return 0;
 }
@@ -0,0 +1,488 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file CameraTraceReplay.cpp
+*
+* Replays a trace written by a wrapper built with TRACE_PARAMETERS.
+*
+* Every recorded parameter string is run through the current fixup code,
+* timed and compared with the recorded result. The same strings also go
+* through the original CameraParameters fixups, so the two paths are
+* compared on real device parameters. With -v the session is
+* also replayed through the wrapper against the stub vendor, which sleeps
+* in each op for as long as the real vendor took; -r keeps the original
+* pacing between ops.
+*
+* usage: camera_trace_replay [-v] [-r] [-q] trace
+*
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <hardware/hardware.h>
+#include <hardware/camera.h>
+#include <utils/Timers.h>
+
+#include "../CameraParameterFixup.h"
+#include "../CameraTrace.h"
+#include "LegacyFixup.h"
+#include "StubVendorCamera.h"
+
+extern camera_module_t HAL_MODULE_INFO_SYM;
+
+typedef struct {
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+} op_summary_t;
+
+typedef struct {
+    const camera_trace_record_t *record;
+    /* terminated copies of the record's strings */
+    const char *before;
+    const char *after;
+} trace_entry_t;
+
+static int gVerbose = 1;
+
+static char *read_trace(const char *path, size_t *size)
+{
+    struct stat st;
+    char *buf;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    buf = (char *)malloc(st.st_size);
+    if (!buf || read(fd, buf, st.st_size) != st.st_size) {
+        fprintf(stderr, "cannot read %s\n", path);
+        free(buf);
+        close(fd);
+        return NULL;
+    }
+
+    close(fd);
+    *size = st.st_size;
+    return buf;
+}
+
+static char *copy_string(const char *p, size_t len)
+{
+    char *s = (char *)malloc(len + 1);
+
+    if (s) {
+        memcpy(s, p, len);
+        s[len] = '\0';
+    }
+    return s;
+}
+
+/* splits the trace into records, returns their number or -1 */
+static int parse_trace(char *buf, size_t size, trace_entry_t **entries)
+{
+    const camera_trace_header_t *header = (const camera_trace_header_t *)buf;
+    size_t pos = sizeof(*header);
+    int count = 0, max = 0;
+
+    if (size < sizeof(*header) || header->magic != CAMERA_TRACE_MAGIC ||
+            header->version != CAMERA_TRACE_VERSION) {
+        fprintf(stderr, "not a camera wrapper trace, or an unsupported version\n");
+        return -1;
+    }
+
+    *entries = NULL;
+    while (pos + sizeof(camera_trace_record_t) <= size) {
+        const camera_trace_record_t *record = (const camera_trace_record_t *)(buf + pos);
+        uint32_t after_len = record->after_len == CAMERA_TRACE_SAME_AFTER ?
+                0 : record->after_len;
+        trace_entry_t *entry;
+
+        pos += sizeof(*record);
+        if (pos + record->before_len + after_len > size) {
+            fprintf(stderr, "trace truncated after %d records\n", count);
+            break;
+        }
+
+        if (count == max) {
+            max = max ? max * 2 : 1024;
+            *entries = (trace_entry_t *)realloc(*entries, max * sizeof(trace_entry_t));
+            if (!*entries)
+                return -1;
+        }
+
+        entry = &(*entries)[count++];
+        entry->record = record;
+        entry->before = NULL;
+        entry->after = NULL;
+        if (record->op == CAMERA_TRACE_PARAMS) {
+            entry->before = copy_string(buf + pos, record->before_len);
+            if (record->after_len == CAMERA_TRACE_SAME_AFTER)
+                entry->after = entry->before;
+            else
+                entry->after = copy_string(buf + pos + record->before_len, after_len);
+            if (!entry->before || !entry->after)
+                return -1;
+        }
+        pos += record->before_len + after_len;
+    }
+
+    return count;
+}
+
+static void summarize_vendor(const trace_entry_t *entries, int count)
+{
+    op_summary_t ops[CAMERA_OP_COUNT];
+    int i;
+
+    memset(ops, 0, sizeof(ops));
+    for (i = 0; i < count; i++) {
+        const camera_trace_record_t *record = entries[i].record;
+
+        if (record->op >= CAMERA_OP_COUNT)
+            continue;
+        ops[record->op].count++;
+        ops[record->op].total_us += record->duration_us;
+        if (record->duration_us > ops[record->op].max_us)
+            ops[record->op].max_us = record->duration_us;
+    }
+
+    printf("%-28s %8s %12s %12s\n", "recorded vendor op", "count", "avg us", "max us");
+    for (i = 0; i < CAMERA_OP_COUNT; i++) {
+        if (!ops[i].count)
+            continue;
+        printf("%-28s %8u %12llu %12u\n", camera_trace_op_name(i), ops[i].count,
+                (unsigned long long)(ops[i].total_us / ops[i].count), ops[i].max_us);
+    }
+}
+
+/*
+ * Runs the original CameraParameters fixup on a recorded string and checks
+ * the arena fixup's result against it key by key, CameraParameters sorting
+ * the keys. Adds the time taken to total, returns 1 when the results differ.
+ */
+static int legacy_fixup(camera_fixup_arena_t *scratch, camera_fixup_arena_t *legacy,
+        int id, int dir, const char *settings, const char *fixed, nsecs_t *total)
+{
+    nsecs_t start;
+    char *result;
+    int differs;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    result = dir == CAMERA_FIXUP_SET ? legacy_fixup_setparams(id, settings) :
+            legacy_fixup_getparams(id, settings);
+    *total += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    differs = !fixed || camera_fixup_snapshot(legacy, result) ||
+            camera_fixup_diff(scratch, legacy, fixed, NULL, NULL) != 0;
+    if (differs && gVerbose)
+        printf("camera %d %s fixup differs from CameraParameters\n  legacy: %s\n  arena:  %s\n",
+                id, dir == CAMERA_FIXUP_SET ? "set" : "get", result, fixed ? fixed : "(failed)");
+    free(result);
+    return differs;
+}
+
+/* returns the number of fixups that no longer give the recorded result */
+static int replay_fixup(const trace_entry_t *entries, int count)
+{
+    camera_fixup_arena_t arena, scratch, legacy;
+    nsecs_t total[CAMERA_FIXUP_DIRECTIONS] = { 0, 0 };
+    nsecs_t legacy_total[CAMERA_FIXUP_DIRECTIONS] = { 0, 0 };
+    int runs[CAMERA_FIXUP_DIRECTIONS] = { 0, 0 };
+    int mismatches = 0, legacy_mismatches = 0;
+    int i, dir;
+
+    if (camera_fixup_arena_init(&arena))
+        return -1;
+    if (camera_fixup_arena_init(&scratch) || camera_fixup_arena_init(&legacy)) {
+        camera_fixup_arena_release(&arena);
+        return -1;
+    }
+    camera_fixup_init();
+
+    for (i = 0; i < count; i++) {
+        const camera_trace_record_t *record = entries[i].record;
+        const char *fixed;
+        nsecs_t start;
+
+        if (record->op != CAMERA_TRACE_PARAMS)
+            continue;
+
+        dir = record->args[0] == CAMERA_FIXUP_SET ? CAMERA_FIXUP_SET : CAMERA_FIXUP_GET;
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        fixed = camera_fixup_apply(&arena, record->camera_id,
+                (camera_fixup_direction_t)dir, entries[i].before);
+        total[dir] += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        runs[dir]++;
+
+        if (!fixed || strcmp(fixed, entries[i].after)) {
+            mismatches++;
+            if (gVerbose)
+                printf("record %d: camera %d %s fixup differs\n  recorded: %s\n  now:      %s\n",
+                        i, record->camera_id, dir == CAMERA_FIXUP_SET ? "set" : "get",
+                        entries[i].after, fixed ? fixed : "(failed)");
+        }
+
+        if (record->camera_id < CAMERA_FIXUP_MAX_CAMERAS)
+            legacy_mismatches += legacy_fixup(&scratch, &legacy, record->camera_id, dir,
+                    entries[i].before, fixed, &legacy_total[dir]);
+    }
+
+    printf("\n%-28s %8s %12s %18s\n", "fixup", "count", "avg ns", "CameraParameters ns");
+    for (dir = 0; dir < CAMERA_FIXUP_DIRECTIONS; dir++) {
+        if (runs[dir])
+            printf("%-28s %8d %12lld %18lld\n", dir == CAMERA_FIXUP_SET ? "set" : "get",
+                    runs[dir], (long long)(total[dir] / runs[dir]),
+                    (long long)(legacy_total[dir] / runs[dir]));
+    }
+    printf("%d of %d fixups differ from the recording\n", mismatches,
+            runs[CAMERA_FIXUP_GET] + runs[CAMERA_FIXUP_SET]);
+    printf("%d of %d fixups differ from CameraParameters\n", legacy_mismatches,
+            runs[CAMERA_FIXUP_GET] + runs[CAMERA_FIXUP_SET]);
+
+    camera_fixup_arena_release(&arena);
+    camera_fixup_arena_release(&scratch);
+    camera_fixup_arena_release(&legacy);
+    return mismatches;
+}
+
+static camera_device_t *replay_device(camera_device_t **devices, int id)
+{
+    char name[12];
+
+    if (id >= CAMERA_FIXUP_MAX_CAMERAS)
+        return NULL;
+    if (!devices[id]) {
+        snprintf(name, sizeof(name), "%d", id);
+        if (HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common,
+                name, (hw_device_t **)&devices[id]))
+            devices[id] = NULL;
+    }
+    return devices[id];
+}
+
+/*
+ * Issues the framework's side of the session: parameter sets as the
+ * framework made them, every other op as recorded. The wrapper's own
+ * vendor calls (forwarded sets, put_parameters) are left to the wrapper.
+ */
+static void replay_vendor(const trace_entry_t *entries, int count, int paced)
+{
+    camera_device_t *devices[CAMERA_FIXUP_MAX_CAMERAS] = { NULL, NULL };
+    op_summary_t ops[CAMERA_OP_COUNT];
+    nsecs_t replay_start, first = 0;
+    int i;
+
+    memset(ops, 0, sizeof(ops));
+    replay_start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    for (i = 0; i < count; i++) {
+        const camera_trace_record_t *record = entries[i].record;
+        camera_device_t *d;
+        nsecs_t start;
+        int op = record->op;
+
+        if (!first)
+            first = record->timestamp;
+        if (paced) {
+            nsecs_t due = replay_start + (record->timestamp - first);
+            nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (due > now)
+                usleep(ns2us(due - now));
+        }
+
+        if (op == CAMERA_TRACE_CLOSE) {
+            if (record->camera_id < CAMERA_FIXUP_MAX_CAMERAS && devices[record->camera_id]) {
+                devices[record->camera_id]->common.close(&devices[record->camera_id]->common);
+                devices[record->camera_id] = NULL;
+            }
+            continue;
+        }
+
+        d = replay_device(devices, record->camera_id);
+        if (!d)
+            continue;
+
+        if (op == CAMERA_TRACE_PARAMS) {
+            if (record->args[0] == CAMERA_FIXUP_SET) {
+                start = systemTime(SYSTEM_TIME_MONOTONIC);
+                d->ops->set_parameters(d, entries[i].before);
+                op = CAMERA_OP_set_parameters;
+                goto account;
+            }
+            continue;
+        }
+        if (op >= CAMERA_OP_COUNT)
+            continue;
+
+        /*
+         * the stub takes as long as the vendor did. A forwarded set's op
+         * record comes just before its parameter record, so the delay is
+         * in place when the set is replayed above.
+         */
+        stub_vendor_set_delay(camera_trace_op_name(op), record->duration_us);
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        switch (op) {
+        case CAMERA_OP_set_preview_window:
+            d->ops->set_preview_window(d, NULL);
+            break;
+        case CAMERA_OP_enable_msg_type:
+            d->ops->enable_msg_type(d, record->args[0]);
+            break;
+        case CAMERA_OP_disable_msg_type:
+            d->ops->disable_msg_type(d, record->args[0]);
+            break;
+        case CAMERA_OP_msg_type_enabled:
+            d->ops->msg_type_enabled(d, record->args[0]);
+            break;
+        case CAMERA_OP_start_preview:
+            d->ops->start_preview(d);
+            break;
+        case CAMERA_OP_stop_preview:
+            d->ops->stop_preview(d);
+            break;
+        case CAMERA_OP_preview_enabled:
+            d->ops->preview_enabled(d);
+            break;
+        case CAMERA_OP_store_meta_data_in_buffers:
+            d->ops->store_meta_data_in_buffers(d, record->args[0]);
+            break;
+        case CAMERA_OP_start_recording:
+            d->ops->start_recording(d);
+            break;
+        case CAMERA_OP_stop_recording:
+            d->ops->stop_recording(d);
+            break;
+        case CAMERA_OP_recording_enabled:
+            d->ops->recording_enabled(d);
+            break;
+        case CAMERA_OP_auto_focus:
+            d->ops->auto_focus(d);
+            break;
+        case CAMERA_OP_cancel_auto_focus:
+            d->ops->cancel_auto_focus(d);
+            break;
+        case CAMERA_OP_take_picture:
+            d->ops->take_picture(d);
+            break;
+        case CAMERA_OP_cancel_picture:
+            d->ops->cancel_picture(d);
+            break;
+        case CAMERA_OP_get_parameters:
+            d->ops->put_parameters(d, d->ops->get_parameters(d));
+            break;
+        case CAMERA_OP_send_command:
+            d->ops->send_command(d, record->args[0], record->args[1], record->args[2]);
+            break;
+        case CAMERA_OP_release:
+            d->ops->release(d);
+            break;
+        default:
+            /* callbacks, recording frames and dump cannot be reproduced */
+            continue;
+        }
+
+account:
+        {
+            uint32_t us = (uint32_t)ns2us(systemTime(SYSTEM_TIME_MONOTONIC) - start);
+
+            ops[op].count++;
+            ops[op].total_us += us;
+            if (us > ops[op].max_us)
+                ops[op].max_us = us;
+        }
+    }
+
+    for (i = 0; i < CAMERA_FIXUP_MAX_CAMERAS; i++) {
+        if (devices[i])
+            devices[i]->common.close(&devices[i]->common);
+    }
+
+    printf("\n%-28s %8s %12s %12s\n", "replayed op", "count", "avg us", "max us");
+    for (i = 0; i < CAMERA_OP_COUNT; i++) {
+        if (!ops[i].count)
+            continue;
+        printf("%-28s %8u %12llu %12u\n", camera_trace_op_name(i), ops[i].count,
+                (unsigned long long)(ops[i].total_us / ops[i].count), ops[i].max_us);
+    }
+    printf("replayed in %lld ms\n",
+            (long long)ns2ms(systemTime(SYSTEM_TIME_MONOTONIC) - replay_start));
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-v] [-r] [-q] trace\n"
+            "  -v  also replay the session through the wrapper and a stub vendor\n"
+            "  -r  keep the recorded time between ops (implies -v)\n"
+            "  -q  do not print differing fixups\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    trace_entry_t *entries;
+    int vendor = 0, paced = 0;
+    size_t size;
+    char *buf;
+    int count, opt, mismatches;
+
+    while ((opt = getopt(argc, argv, "vrq")) != -1) {
+        switch (opt) {
+        case 'v':
+            vendor = 1;
+            break;
+        case 'r':
+            vendor = paced = 1;
+            break;
+        case 'q':
+            gVerbose = 0;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    buf = read_trace(argv[optind], &size);
+    if (!buf)
+        return 1;
+
+    count = parse_trace(buf, size, &entries);
+    if (count < 0)
+        return 1;
+    printf("%d records\n\n", count);
+
+    summarize_vendor(entries, count);
+    mismatches = replay_fixup(entries, count);
+    if (vendor)
+        replay_vendor(entries, count, paced);
+
+    /* the strings are left to the exit */
+    free(entries);
+    free(buf);
+    return mismatches ? 2 : 0;
+}
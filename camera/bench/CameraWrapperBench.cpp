@@ -0,0 +1,466 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file CameraWrapperBench.cpp
+*
+* Host benchmark of the camera wrapper. The wrapper is linked against
+* StubVendorCamera instead of the vendor blob and every forwarded op, as
+* well as frames coming back through the callbacks, is timed through the
+* wrapper and directly against the stub, so the difference is the
+* wrapper's own cost.
+*
+* usage: camera_wrapper_bench [-n iterations] [-d op=usecs]...
+*
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <hardware/hardware.h>
+#include <hardware/camera.h>
+#include <utils/Timers.h>
+
+#include "../CameraParameterFixup.h"
+#include "ExynosParameters.h"
+#include "LegacyFixup.h"
+#include "StubVendorCamera.h"
+
+#define DEFAULT_ITERATIONS 10000
+/* opens power up the sensor, so they get far fewer rounds */
+#define OPEN_ITERATIONS 20
+
+extern camera_module_t HAL_MODULE_INFO_SYM;
+
+static int gNullFd = -1;
+static char *gAltParameters;
+static char *gVideoParameters;
+/* the wrapper under test and the stub device it opened */
+static camera_device_t *gWrapper;
+static camera_device_t *gWrapperVendor;
+
+typedef struct {
+    const char *name;
+    void (*run)(camera_device_t *device, int i);
+} bench_op_t;
+
+/* the stub device that delivers frames to d, d itself when it is a stub */
+static camera_device_t *vendor_of(camera_device_t *d)
+{
+    return d == gWrapper ? gWrapperVendor : d;
+}
+
+static void bench_notify_cb(int32_t msg_type, int32_t ext1, int32_t ext2, void *user)
+{
+}
+
+static void bench_data_cb(int32_t msg_type, const camera_memory_t *data,
+        unsigned int index, camera_frame_metadata_t *metadata, void *user)
+{
+}
+
+static void bench_data_timestamp_cb(int64_t timestamp, int32_t msg_type,
+        const camera_memory_t *data, unsigned int index, void *user)
+{
+}
+
+static void bench_release_memory(camera_memory_t *mem)
+{
+    free(mem->data);
+    free(mem);
+}
+
+static camera_memory_t *bench_get_memory(int fd, size_t buf_size, unsigned int num_bufs,
+        void *user)
+{
+    camera_memory_t *mem = (camera_memory_t *)malloc(sizeof(*mem));
+
+    if (!mem)
+        return NULL;
+    mem->data = malloc(buf_size * num_bufs);
+    if (!mem->data) {
+        free(mem);
+        return NULL;
+    }
+    mem->size = buf_size * num_bufs;
+    mem->handle = NULL;
+    mem->release = bench_release_memory;
+    return mem;
+}
+
+static void op_set_preview_window(camera_device_t *d, int i)
+{
+    d->ops->set_preview_window(d, NULL);
+}
+
+static void op_set_callbacks(camera_device_t *d, int i)
+{
+    d->ops->set_callbacks(d, bench_notify_cb, bench_data_cb, bench_data_timestamp_cb,
+            bench_get_memory, NULL);
+}
+
+/* vendor to framework, through the wrapper's trampolines */
+static void op_preview_frame(camera_device_t *d, int i)
+{
+    stub_vendor_deliver_frame(vendor_of(d), CAMERA_MSG_PREVIEW_FRAME, 0);
+}
+
+/* a recording frame the encoder hands back at once, 30 fps timestamps */
+static void op_recording_frame(camera_device_t *d, int i)
+{
+    const void *opaque = stub_vendor_deliver_frame(vendor_of(d), CAMERA_MSG_VIDEO_FRAME,
+            (nsecs_t)i * 33333333);
+
+    if (opaque)
+        d->ops->release_recording_frame(d, opaque);
+}
+
+static void op_enable_msg_type(camera_device_t *d, int i)
+{
+    d->ops->enable_msg_type(d, CAMERA_MSG_PREVIEW_FRAME);
+}
+
+static void op_disable_msg_type(camera_device_t *d, int i)
+{
+    d->ops->disable_msg_type(d, CAMERA_MSG_PREVIEW_FRAME);
+}
+
+static void op_msg_type_enabled(camera_device_t *d, int i)
+{
+    d->ops->msg_type_enabled(d, CAMERA_MSG_PREVIEW_FRAME);
+}
+
+static void op_start_preview(camera_device_t *d, int i)
+{
+    d->ops->start_preview(d);
+}
+
+static void op_stop_preview(camera_device_t *d, int i)
+{
+    d->ops->stop_preview(d);
+}
+
+static void op_preview_enabled(camera_device_t *d, int i)
+{
+    d->ops->preview_enabled(d);
+}
+
+static void op_store_meta_data_in_buffers(camera_device_t *d, int i)
+{
+    d->ops->store_meta_data_in_buffers(d, 0);
+}
+
+static void op_start_recording(camera_device_t *d, int i)
+{
+    d->ops->start_recording(d);
+}
+
+static void op_stop_recording(camera_device_t *d, int i)
+{
+    d->ops->stop_recording(d);
+}
+
+static void op_recording_enabled(camera_device_t *d, int i)
+{
+    d->ops->recording_enabled(d);
+}
+
+static void op_auto_focus(camera_device_t *d, int i)
+{
+    d->ops->auto_focus(d);
+}
+
+static void op_cancel_auto_focus(camera_device_t *d, int i)
+{
+    d->ops->cancel_auto_focus(d);
+}
+
+static void op_take_picture(camera_device_t *d, int i)
+{
+    d->ops->take_picture(d);
+}
+
+static void op_cancel_picture(camera_device_t *d, int i)
+{
+    d->ops->cancel_picture(d);
+}
+
+static void op_get_put_parameters(camera_device_t *d, int i)
+{
+    d->ops->put_parameters(d, d->ops->get_parameters(d));
+}
+
+/* the same string every time, which the wrapper does not forward */
+static void op_set_parameters_same(camera_device_t *d, int i)
+{
+    d->ops->set_parameters(d, exynos_back_parameters);
+}
+
+static void op_set_parameters_changing(camera_device_t *d, int i)
+{
+    d->ops->set_parameters(d, (i & 1) ? gAltParameters : exynos_back_parameters);
+}
+
+/* still/video switches, served from the wrapper's mode profiles */
+static void op_set_parameters_cam_mode(camera_device_t *d, int i)
+{
+    d->ops->set_parameters(d, (i & 1) ? gVideoParameters : exynos_back_parameters);
+}
+
+static void op_send_command(camera_device_t *d, int i)
+{
+    d->ops->send_command(d, CAMERA_CMD_PLAY_RECORDING_SOUND, 0, 0);
+}
+
+static void op_dump(camera_device_t *d, int i)
+{
+    d->ops->dump(d, gNullFd);
+}
+
+static void op_release(camera_device_t *d, int i)
+{
+    d->ops->release(d);
+}
+
+static const bench_op_t bench_ops[] = {
+    { "set_preview_window", op_set_preview_window },
+    { "set_callbacks", op_set_callbacks },
+    { "enable_msg_type", op_enable_msg_type },
+    { "disable_msg_type", op_disable_msg_type },
+    { "msg_type_enabled", op_msg_type_enabled },
+    { "start_preview", op_start_preview },
+    { "preview_enabled", op_preview_enabled },
+    { "stop_preview", op_stop_preview },
+    { "store_meta_data_in_buffers", op_store_meta_data_in_buffers },
+    { "start_recording", op_start_recording },
+    { "recording_enabled", op_recording_enabled },
+    { "stop_recording", op_stop_recording },
+    { "auto_focus", op_auto_focus },
+    { "cancel_auto_focus", op_cancel_auto_focus },
+    { "take_picture", op_take_picture },
+    { "cancel_picture", op_cancel_picture },
+    { "get+put_parameters", op_get_put_parameters },
+    { "set_parameters(same)", op_set_parameters_same },
+    { "set_parameters(changing)", op_set_parameters_changing },
+    { "set_parameters(cam_mode)", op_set_parameters_cam_mode },
+    { "send_command", op_send_command },
+    /* after the start ops, which reset the frame statistics */
+    { "preview frame(data_cb)", op_preview_frame },
+    { "video frame+release", op_recording_frame },
+    { "dump", op_dump },
+    { "release", op_release },
+};
+
+static nsecs_t time_op(camera_device_t *device, const bench_op_t *op, int iterations)
+{
+    nsecs_t start;
+    int i;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (i = 0; i < iterations; i++)
+        op->run(device, i);
+    return (systemTime(SYSTEM_TIME_MONOTONIC) - start) / iterations;
+}
+
+static int open_camera(const hw_module_t *module, const char *name, camera_device_t **device)
+{
+    return module->methods->open(module, name, (hw_device_t **)device);
+}
+
+static void bench_forwarded_ops(int iterations)
+{
+    camera_device_t *wrapper, *stub;
+    size_t i;
+
+    if (open_camera(&HAL_MODULE_INFO_SYM.common, "0", &wrapper)) {
+        fprintf(stderr, "camera open failed\n");
+        exit(1);
+    }
+    gWrapper = wrapper;
+    gWrapperVendor = stub_vendor_last_opened();
+    if (open_camera(&gStubVendorModule.common, "0", &stub)) {
+        fprintf(stderr, "camera open failed\n");
+        exit(1);
+    }
+
+    printf("%-28s %12s %12s %12s\n", "op", "wrapper ns", "vendor ns", "overhead ns");
+    for (i = 0; i < sizeof(bench_ops) / sizeof(bench_ops[0]); i++) {
+        nsecs_t wrapped = time_op(wrapper, &bench_ops[i], iterations);
+        nsecs_t direct = time_op(stub, &bench_ops[i], iterations);
+
+        printf("%-28s %12lld %12lld %12lld\n", bench_ops[i].name,
+                (long long)wrapped, (long long)direct, (long long)(wrapped - direct));
+    }
+
+    wrapper->common.close(&wrapper->common);
+    stub->common.close(&stub->common);
+    gWrapper = gWrapperVendor = NULL;
+}
+
+static void bench_fixup(int iterations)
+{
+    camera_fixup_arena_t arena, snapshot;
+    nsecs_t start;
+    int i;
+
+    if (camera_fixup_arena_init(&arena) || camera_fixup_arena_init(&snapshot)) {
+        fprintf(stderr, "arena allocation failed\n");
+        exit(1);
+    }
+    camera_fixup_init();
+    camera_fixup_snapshot(&snapshot, exynos_back_parameters);
+
+    printf("\n%-28s %12s\n", "fixup path", "ns/op");
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (i = 0; i < iterations; i++)
+        camera_fixup_apply(&arena, i & 1, CAMERA_FIXUP_GET,
+                (i & 1) ? exynos_front_parameters : exynos_back_parameters);
+    printf("%-28s %12lld\n", "apply(get)",
+            (long long)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / iterations));
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (i = 0; i < iterations; i++)
+        camera_fixup_apply(&arena, i & 1, CAMERA_FIXUP_SET,
+                (i & 1) ? exynos_front_parameters : exynos_back_parameters);
+    printf("%-28s %12lld\n", "apply(set)",
+            (long long)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / iterations));
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (i = 0; i < iterations; i++)
+        free(camera_fixup_params(0, CAMERA_FIXUP_GET, exynos_back_parameters));
+    printf("%-28s %12lld\n", "params(get, malloc)",
+            (long long)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / iterations));
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (i = 0; i < iterations; i++)
+        camera_fixup_diff(&arena, &snapshot,
+                (i & 1) ? gAltParameters : exynos_back_parameters, NULL, NULL);
+    printf("%-28s %12lld\n", "diff",
+            (long long)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / iterations));
+
+    /* the CameraParameters path the arena fixups replaced */
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (i = 0; i < iterations; i++)
+        free(legacy_fixup_getparams(i & 1,
+                (i & 1) ? exynos_front_parameters : exynos_back_parameters));
+    printf("%-28s %12lld\n", "CameraParameters(get)",
+            (long long)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / iterations));
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (i = 0; i < iterations; i++)
+        free(legacy_fixup_setparams(i & 1,
+                (i & 1) ? exynos_front_parameters : exynos_back_parameters));
+    printf("%-28s %12lld\n", "CameraParameters(set)",
+            (long long)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / iterations));
+
+    camera_fixup_arena_release(&arena);
+    camera_fixup_arena_release(&snapshot);
+}
+
+static void *open_close_thread(void *arg)
+{
+    camera_device_t *device;
+
+    if (!open_camera(&HAL_MODULE_INFO_SYM.common, (const char *)arg, &device))
+        device->common.close(&device->common);
+    return NULL;
+}
+
+static void bench_open(void)
+{
+    pthread_t threads[2];
+    nsecs_t start;
+    int i;
+
+    printf("\n%-28s %12s\n", "open+close cameras 0 and 1", "ns/op");
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (i = 0; i < OPEN_ITERATIONS; i++) {
+        open_close_thread((void *)"0");
+        open_close_thread((void *)"1");
+    }
+    printf("%-28s %12lld\n", "sequential",
+            (long long)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / OPEN_ITERATIONS));
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (i = 0; i < OPEN_ITERATIONS; i++) {
+        pthread_create(&threads[0], NULL, open_close_thread, (void *)"0");
+        pthread_create(&threads[1], NULL, open_close_thread, (void *)"1");
+        pthread_join(threads[0], NULL);
+        pthread_join(threads[1], NULL);
+    }
+    printf("%-28s %12lld\n", "concurrent",
+            (long long)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / OPEN_ITERATIONS));
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-n iterations] [-d op=usecs]...\n"
+            "  -d  make the stub vendor sleep in op (\"open\" or a camera_device_ops name)\n",
+            name);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = DEFAULT_ITERATIONS;
+    char *eq;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            if (iterations <= 0)
+                usage(argv[0]);
+            break;
+        case 'd':
+            eq = strchr(optarg, '=');
+            if (!eq)
+                usage(argv[0]);
+            *eq = '\0';
+            if (stub_vendor_set_delay(optarg, atoi(eq + 1))) {
+                fprintf(stderr, "unknown op %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    gNullFd = open("/dev/null", O_WRONLY);
+
+    /* differs from the back camera defaults in one key */
+    if (asprintf(&gAltParameters, "%s;bench-key=1", exynos_back_parameters) < 0 ||
+            asprintf(&gVideoParameters, "%s;cam_mode=1", exynos_back_parameters) < 0)
+        return 1;
+
+    printf("%d iterations\n\n", iterations);
+    bench_forwarded_ops(iterations);
+    bench_fixup(iterations);
+    bench_open();
+
+    free(gAltParameters);
+    free(gVideoParameters);
+    close(gNullFd);
+    return 0;
+}
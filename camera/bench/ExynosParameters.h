@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file ExynosParameters.h
+*
+* Parameter strings modelled on the get_parameters output of the GT-I9100
+* camera blob right after opening each camera: same keys, same value
+* lists, same length.
+*
+*/
+
+#ifndef EXYNOS_PARAMETERS_H
+#define EXYNOS_PARAMETERS_H
+
+static const char *exynos_back_parameters =
+    "anti-shake=0;antibanding=auto;antibanding-values=auto,50hz,60hz,off;"
+    "auto-exposure-lock=false;auto-exposure-lock-supported=true;"
+    "auto-whitebalance-lock=false;auto-whitebalance-lock-supported=true;"
+    "beauty-shot=0;blur=0;chk_dataline=0;contrast=2;effect=none;"
+    "effect-values=none,mono,negative,sepia,aqua;exposure-compensation=0;"
+    "exposure-compensation-step=0.5;flash-mode=off;flash-mode-values=off,auto,on,torch;"
+    "focal-length=4.03;focus-areas=(0,0,0,0,0);focus-distances=0.15,1.20,Infinity;"
+    "focus-mode=auto;focus-mode-values=auto,macro,continuous-video,continuous-picture;"
+    "gps-altitude=0;gps-latitude=0;gps-longitude=0;gps-timestamp=0;"
+    "horizontal-view-angle=51.2;iso=auto;iso-values=auto,50,100,200,400,800;"
+    "jpeg-quality=100;jpeg-thumbnail-height=240;jpeg-thumbnail-quality=100;"
+    "jpeg-thumbnail-size-values=320x240,400x240,0x0;jpeg-thumbnail-width=320;"
+    "max-exposure-compensation=4;max-num-detected-faces-hw=0;"
+    "max-num-detected-faces-sw=0;max-num-focus-areas=1;max-num-metering-areas=0;"
+    "max-zoom=30;metering=center;min-exposure-compensation=-4;picture-format=jpeg;"
+    "picture-format-values=jpeg;picture-size=3264x2448;"
+    "picture-size-values=3264x2448,3264x1968,2048x1536,2048x1232,1600x1200,"
+    "1600x960,800x480,640x480;preview-format=yuv420sp;"
+    "preview-format-values=yuv420sp,yuv420p;preview-fps-range=15000,30000;"
+    "preview-fps-range-values=(15000,30000);preview-frame-rate=30;"
+    "preview-frame-rate-values=30,25,20,15,10,7;preview-size=640x480;"
+    "preview-size-values=1280x720,800x480,720x480,640x480,320x240,176x144;"
+    "rotation=0;saturation=2;scene-mode=auto;"
+    "scene-mode-values=auto,portrait,landscape,night,beach,snow,sunset,fireworks,"
+    "sports,party,candlelight,back-light,dusk-dawn,fall-color,text;sharpness=2;"
+    "smooth-zoom-supported=false;vertical-view-angle=39.4;"
+    "video-frame-format=yuv420sp;video-size=1920x1080;"
+    "video-size-values=1920x1080,1280x720,640x480,320x240;"
+    "video-stabilization-supported=false;vtmode=0;wdr=0;whitebalance=auto;"
+    "whitebalance-values=auto,incandescent,fluorescent,daylight,cloudy-daylight;"
+    "zoom=0;zoom-ratios=100,102,104,109,111,113,119,121,124,131,134,138,146,150,"
+    "155,159,165,170,182,189,200,213,222,232,243,255,283,300,319,364,400;"
+    "zoom-supported=true";
+
+static const char *exynos_front_parameters =
+    "anti-shake=0;antibanding=auto;antibanding-values=auto,50hz,60hz,off;"
+    "auto-exposure-lock=false;auto-exposure-lock-supported=false;"
+    "auto-whitebalance-lock=false;auto-whitebalance-lock-supported=false;"
+    "beauty-shot=0;blur=0;chk_dataline=0;contrast=2;effect=none;"
+    "effect-values=none,mono,negative,sepia,aqua;exposure-compensation=0;"
+    "exposure-compensation-step=0.5;focal-length=0.9;focus-distances=0.20,0.25,Infinity;"
+    "focus-mode=fixed;focus-mode-values=fixed;gps-altitude=0;gps-latitude=0;"
+    "gps-longitude=0;gps-timestamp=0;horizontal-view-angle=54.4;iso=auto;"
+    "iso-values=auto;jpeg-quality=100;jpeg-thumbnail-height=120;"
+    "jpeg-thumbnail-quality=100;jpeg-thumbnail-size-values=160x120,0x0;"
+    "jpeg-thumbnail-width=160;max-exposure-compensation=4;max-num-focus-areas=0;"
+    "max-zoom=0;metering=center;min-exposure-compensation=-4;picture-format=jpeg;"
+    "picture-format-values=jpeg;picture-size=1392x1392;"
+    "picture-size-values=1392x1392,1280x960,640x480;preview-format=yuv420sp;"
+    "preview-format-values=yuv420sp,yuv420p;preview-fps-range=7500,30000;"
+    "preview-fps-range-values=(7500,30000);preview-frame-rate=30;"
+    "preview-frame-rate-values=30,15,7;preview-size=640x480;"
+    "preview-size-values=640x480,352x288,320x240,176x144;rotation=0;saturation=2;"
+    "scene-mode=auto;scene-mode-values=auto;sharpness=2;smooth-zoom-supported=false;"
+    "vertical-view-angle=39.4;video-frame-format=yuv420sp;video-size=640x480;"
+    "video-size-values=640x480,352x288,320x240,176x144;"
+    "video-stabilization-supported=false;vtmode=0;wdr=0;whitebalance=auto;"
+    "whitebalance-values=auto,incandescent,fluorescent,daylight,cloudy-daylight;"
+    "zoom=0;zoom-supported=false";
+
+#endif /* EXYNOS_PARAMETERS_H */
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file LegacyFixup.cpp
+*
+* camera_fixup_getparams and camera_fixup_setparams as the wrapper had
+* them before the table driven fixups, minus the logging.
+*
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <camera/CameraParameters.h>
+
+#include "LegacyFixup.h"
+
+const static char * video_preview_sizes[] = {
+    "1920x1080,1280x720,640x480",
+    "640x480,352x288,320x240,176x144"
+};
+
+char *legacy_fixup_getparams(int id, const char *settings)
+{
+    android::CameraParameters params;
+    params.unflatten(android::String8(settings));
+
+    params.remove(android::CameraParameters::KEY_SUPPORTED_VIDEO_SIZES);
+
+    if(params.get("cam_mode"))
+    {
+        params.set(android::CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES, video_preview_sizes[id]);
+        const char* videoSize = params.get(android::CameraParameters::KEY_VIDEO_SIZE);
+        params.set(android::CameraParameters::KEY_PREVIEW_SIZE, videoSize);
+    }
+
+    android::String8 strParams = params.flatten();
+    char *ret = strdup(strParams.string());
+
+    return ret;
+}
+
+char *legacy_fixup_setparams(int id, const char *settings)
+{
+    android::CameraParameters params;
+    params.unflatten(android::String8(settings));
+
+    if(params.get("cam_mode"))
+    {
+        const char* previewSize = params.get(android::CameraParameters::KEY_PREVIEW_SIZE);
+        params.set(android::CameraParameters::KEY_PREFERRED_PREVIEW_SIZE_FOR_VIDEO, previewSize);
+        params.set(android::CameraParameters::KEY_SUPPORTED_VIDEO_SIZES, video_preview_sizes[id]);
+    }
+
+    android::String8 strParams = params.flatten();
+    char *ret = strdup(strParams.string());
+
+    return ret;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file LegacyFixup.h
+*
+* The wrapper's original CameraParameters based fixups, kept as the
+* baseline the arena fixups are benchmarked and checked against.
+*
+*/
+
+#ifndef LEGACY_FIXUP_H
+#define LEGACY_FIXUP_H
+
+/* both return a malloc'ed string */
+char *legacy_fixup_getparams(int id, const char *settings);
+char *legacy_fixup_setparams(int id, const char *settings);
+
+#endif /* LEGACY_FIXUP_H */
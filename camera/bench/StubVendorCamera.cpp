@@ -0,0 +1,445 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file StubVendorCamera.cpp
+*
+* A fake vendor camera module: two cameras reporting Exynos parameter
+* strings, every op optionally sleeping for a configurable time. Frames
+* are delivered through the callbacks passed to set_callbacks, in buffers
+* requested with its get_memory, like the blob does.
+*
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ExynosParameters.h"
+#include "StubVendorCamera.h"
+
+#define STUB_NUM_CAMERAS 2
+/* a 640x480 NV21 frame */
+#define STUB_FRAME_SIZE (640 * 480 * 3 / 2)
+#define STUB_FRAME_BUFFERS 8
+
+static const char *stub_op_names[] = {
+    "open",
+    "set_preview_window", "set_callbacks", "enable_msg_type", "disable_msg_type",
+    "msg_type_enabled", "start_preview", "stop_preview", "preview_enabled",
+    "store_meta_data_in_buffers", "start_recording", "stop_recording",
+    "recording_enabled", "release_recording_frame", "auto_focus",
+    "cancel_auto_focus", "take_picture", "cancel_picture", "set_parameters",
+    "get_parameters", "put_parameters", "send_command", "release", "dump",
+};
+
+#define STUB_OP_COUNT (int)(sizeof(stub_op_names) / sizeof(stub_op_names[0]))
+
+enum {
+    STUB_OPEN,
+    STUB_SET_PREVIEW_WINDOW, STUB_SET_CALLBACKS, STUB_ENABLE_MSG_TYPE,
+    STUB_DISABLE_MSG_TYPE, STUB_MSG_TYPE_ENABLED, STUB_START_PREVIEW,
+    STUB_STOP_PREVIEW, STUB_PREVIEW_ENABLED, STUB_STORE_META_DATA_IN_BUFFERS,
+    STUB_START_RECORDING, STUB_STOP_RECORDING, STUB_RECORDING_ENABLED,
+    STUB_RELEASE_RECORDING_FRAME, STUB_AUTO_FOCUS, STUB_CANCEL_AUTO_FOCUS,
+    STUB_TAKE_PICTURE, STUB_CANCEL_PICTURE, STUB_SET_PARAMETERS,
+    STUB_GET_PARAMETERS, STUB_PUT_PARAMETERS, STUB_SEND_COMMAND, STUB_RELEASE,
+    STUB_DUMP,
+};
+
+static unsigned int stub_delays[STUB_OP_COUNT];
+
+typedef struct {
+    camera_device_t base;
+    int id;
+    pthread_mutex_t lock;
+    char *params;
+    int32_t msg_types;
+    int previewing;
+    int recording;
+
+    camera_notify_callback notify_cb;
+    camera_data_callback data_cb;
+    camera_data_timestamp_callback data_cb_timestamp;
+    camera_request_memory get_memory;
+    void *user;
+    /* requested on the first frame, released on close */
+    camera_memory_t *frames;
+    unsigned int next_frame;
+} stub_camera_device_t;
+
+static stub_camera_device_t *stub_last_opened;
+
+static void stub_delay(int op)
+{
+    if (stub_delays[op])
+        usleep(stub_delays[op]);
+}
+
+int stub_vendor_set_delay(const char *op, unsigned int usecs)
+{
+    int i;
+
+    for (i = 0; i < STUB_OP_COUNT; i++) {
+        if (!strcmp(stub_op_names[i], op)) {
+            stub_delays[i] = usecs;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static stub_camera_device_t *stub_dev(struct camera_device *device)
+{
+    return (stub_camera_device_t *)device;
+}
+
+static int stub_set_preview_window(struct camera_device *device,
+        struct preview_stream_ops *window)
+{
+    stub_delay(STUB_SET_PREVIEW_WINDOW);
+    return 0;
+}
+
+static void stub_set_callbacks(struct camera_device *device,
+        camera_notify_callback notify_cb, camera_data_callback data_cb,
+        camera_data_timestamp_callback data_cb_timestamp,
+        camera_request_memory get_memory, void *user)
+{
+    stub_camera_device_t *dev = stub_dev(device);
+
+    stub_delay(STUB_SET_CALLBACKS);
+
+    pthread_mutex_lock(&dev->lock);
+    dev->notify_cb = notify_cb;
+    dev->data_cb = data_cb;
+    dev->data_cb_timestamp = data_cb_timestamp;
+    dev->get_memory = get_memory;
+    dev->user = user;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+static void stub_enable_msg_type(struct camera_device *device, int32_t msg_type)
+{
+    stub_delay(STUB_ENABLE_MSG_TYPE);
+    stub_dev(device)->msg_types |= msg_type;
+}
+
+static void stub_disable_msg_type(struct camera_device *device, int32_t msg_type)
+{
+    stub_delay(STUB_DISABLE_MSG_TYPE);
+    stub_dev(device)->msg_types &= ~msg_type;
+}
+
+static int stub_msg_type_enabled(struct camera_device *device, int32_t msg_type)
+{
+    stub_delay(STUB_MSG_TYPE_ENABLED);
+    return (stub_dev(device)->msg_types & msg_type) == msg_type;
+}
+
+static int stub_start_preview(struct camera_device *device)
+{
+    stub_delay(STUB_START_PREVIEW);
+    stub_dev(device)->previewing = 1;
+    return 0;
+}
+
+static void stub_stop_preview(struct camera_device *device)
+{
+    stub_delay(STUB_STOP_PREVIEW);
+    stub_dev(device)->previewing = 0;
+}
+
+static int stub_preview_enabled(struct camera_device *device)
+{
+    stub_delay(STUB_PREVIEW_ENABLED);
+    return stub_dev(device)->previewing;
+}
+
+static int stub_store_meta_data_in_buffers(struct camera_device *device, int enable)
+{
+    stub_delay(STUB_STORE_META_DATA_IN_BUFFERS);
+    return 0;
+}
+
+static int stub_start_recording(struct camera_device *device)
+{
+    stub_delay(STUB_START_RECORDING);
+    stub_dev(device)->recording = 1;
+    return 0;
+}
+
+static void stub_stop_recording(struct camera_device *device)
+{
+    stub_delay(STUB_STOP_RECORDING);
+    stub_dev(device)->recording = 0;
+}
+
+static int stub_recording_enabled(struct camera_device *device)
+{
+    stub_delay(STUB_RECORDING_ENABLED);
+    return stub_dev(device)->recording;
+}
+
+static void stub_release_recording_frame(struct camera_device *device,
+        const void *opaque)
+{
+    stub_delay(STUB_RELEASE_RECORDING_FRAME);
+}
+
+static int stub_auto_focus(struct camera_device *device)
+{
+    stub_delay(STUB_AUTO_FOCUS);
+    return 0;
+}
+
+static int stub_cancel_auto_focus(struct camera_device *device)
+{
+    stub_delay(STUB_CANCEL_AUTO_FOCUS);
+    return 0;
+}
+
+static int stub_take_picture(struct camera_device *device)
+{
+    stub_delay(STUB_TAKE_PICTURE);
+    return 0;
+}
+
+static int stub_cancel_picture(struct camera_device *device)
+{
+    stub_delay(STUB_CANCEL_PICTURE);
+    return 0;
+}
+
+static int stub_set_parameters(struct camera_device *device, const char *params)
+{
+    stub_camera_device_t *dev = stub_dev(device);
+    char *copy;
+
+    stub_delay(STUB_SET_PARAMETERS);
+
+    copy = strdup(params);
+    if (!copy)
+        return -ENOMEM;
+
+    pthread_mutex_lock(&dev->lock);
+    free(dev->params);
+    dev->params = copy;
+    pthread_mutex_unlock(&dev->lock);
+    return 0;
+}
+
+static char *stub_get_parameters(struct camera_device *device)
+{
+    stub_camera_device_t *dev = stub_dev(device);
+    char *ret;
+
+    stub_delay(STUB_GET_PARAMETERS);
+
+    pthread_mutex_lock(&dev->lock);
+    ret = strdup(dev->params);
+    pthread_mutex_unlock(&dev->lock);
+    return ret;
+}
+
+static void stub_put_parameters(struct camera_device *device, char *params)
+{
+    stub_delay(STUB_PUT_PARAMETERS);
+    free(params);
+}
+
+static int stub_send_command(struct camera_device *device, int32_t cmd,
+        int32_t arg1, int32_t arg2)
+{
+    stub_delay(STUB_SEND_COMMAND);
+    return 0;
+}
+
+static void stub_release(struct camera_device *device)
+{
+    stub_delay(STUB_RELEASE);
+}
+
+static int stub_dump(struct camera_device *device, int fd)
+{
+    stub_delay(STUB_DUMP);
+    return 0;
+}
+
+static camera_device_ops_t stub_ops = {
+    set_preview_window: stub_set_preview_window,
+    set_callbacks: stub_set_callbacks,
+    enable_msg_type: stub_enable_msg_type,
+    disable_msg_type: stub_disable_msg_type,
+    msg_type_enabled: stub_msg_type_enabled,
+    start_preview: stub_start_preview,
+    stop_preview: stub_stop_preview,
+    preview_enabled: stub_preview_enabled,
+    store_meta_data_in_buffers: stub_store_meta_data_in_buffers,
+    start_recording: stub_start_recording,
+    stop_recording: stub_stop_recording,
+    recording_enabled: stub_recording_enabled,
+    release_recording_frame: stub_release_recording_frame,
+    auto_focus: stub_auto_focus,
+    cancel_auto_focus: stub_cancel_auto_focus,
+    take_picture: stub_take_picture,
+    cancel_picture: stub_cancel_picture,
+    set_parameters: stub_set_parameters,
+    get_parameters: stub_get_parameters,
+    put_parameters: stub_put_parameters,
+    send_command: stub_send_command,
+    release: stub_release,
+    dump: stub_dump,
+};
+
+camera_device_ops_t *stub_vendor_ops(void)
+{
+    return &stub_ops;
+}
+
+camera_device_t *stub_vendor_last_opened(void)
+{
+    return stub_last_opened ? &stub_last_opened->base : NULL;
+}
+
+const void *stub_vendor_deliver_frame(camera_device_t *device, int32_t msg_type,
+        nsecs_t timestamp)
+{
+    stub_camera_device_t *dev = stub_dev(device);
+    camera_data_callback data_cb;
+    camera_data_timestamp_callback data_cb_timestamp;
+    camera_memory_t *frames;
+    unsigned int index;
+    void *user;
+
+    pthread_mutex_lock(&dev->lock);
+    if (!dev->frames && dev->get_memory)
+        dev->frames = dev->get_memory(-1, STUB_FRAME_SIZE, STUB_FRAME_BUFFERS, dev->user);
+    frames = dev->frames;
+    index = dev->next_frame++ % STUB_FRAME_BUFFERS;
+    data_cb = dev->data_cb;
+    data_cb_timestamp = dev->data_cb_timestamp;
+    user = dev->user;
+    pthread_mutex_unlock(&dev->lock);
+
+    if (!frames)
+        return NULL;
+
+    if (msg_type == CAMERA_MSG_VIDEO_FRAME) {
+        if (!data_cb_timestamp)
+            return NULL;
+        data_cb_timestamp(timestamp, msg_type, frames, index, user);
+    } else {
+        if (!data_cb)
+            return NULL;
+        data_cb(msg_type, frames, index, NULL, user);
+    }
+    return (const char *)frames->data + index * STUB_FRAME_SIZE;
+}
+
+static int stub_device_close(hw_device_t *device)
+{
+    stub_camera_device_t *dev = (stub_camera_device_t *)device;
+
+    if (stub_last_opened == dev)
+        stub_last_opened = NULL;
+    if (dev->frames)
+        dev->frames->release(dev->frames);
+    pthread_mutex_destroy(&dev->lock);
+    free(dev->params);
+    free(dev);
+    return 0;
+}
+
+static int stub_device_open(const hw_module_t *module, const char *name,
+        hw_device_t **device)
+{
+    stub_camera_device_t *dev;
+    int id = atoi(name);
+
+    if (id < 0 || id >= STUB_NUM_CAMERAS)
+        return -EINVAL;
+
+    /* a real sensor power-up, the part opens are serialized on */
+    stub_delay(STUB_OPEN);
+
+    dev = (stub_camera_device_t *)calloc(1, sizeof(*dev));
+    if (!dev)
+        return -ENOMEM;
+
+    dev->params = strdup(id ? exynos_front_parameters : exynos_back_parameters);
+    if (!dev->params) {
+        free(dev);
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&dev->lock, NULL);
+    dev->id = id;
+    dev->base.common.tag = HARDWARE_DEVICE_TAG;
+    dev->base.common.module = (hw_module_t *)module;
+    dev->base.common.close = stub_device_close;
+    dev->base.ops = &stub_ops;
+
+    stub_last_opened = dev;
+    *device = &dev->base.common;
+    return 0;
+}
+
+static int stub_get_number_of_cameras(void)
+{
+    return STUB_NUM_CAMERAS;
+}
+
+static int stub_get_camera_info(int camera_id, struct camera_info *info)
+{
+    if (camera_id < 0 || camera_id >= STUB_NUM_CAMERAS)
+        return -EINVAL;
+
+    info->facing = camera_id ? CAMERA_FACING_FRONT : CAMERA_FACING_BACK;
+    info->orientation = camera_id ? 270 : 90;
+    return 0;
+}
+
+static struct hw_module_methods_t stub_module_methods = {
+    open: stub_device_open
+};
+
+/* the wrapper loads its vendor module through this */
+int hw_get_module(const char *id, const struct hw_module_t **module)
+{
+    if (strcmp(id, "vendor-camera"))
+        return -ENOENT;
+    *module = &gStubVendorModule.common;
+    return 0;
+}
+
+camera_module_t gStubVendorModule = {
+    common: {
+        tag: HARDWARE_MODULE_TAG,
+        version_major: 1,
+        version_minor: 0,
+        id: "vendor-camera",
+        name: "Stub Vendor Camera",
+        author: "The CyanogenMod Project",
+        methods: &stub_module_methods,
+        dso: NULL,
+        reserved: {0},
+    },
+    get_number_of_cameras: stub_get_number_of_cameras,
+    get_camera_info: stub_get_camera_info,
+};
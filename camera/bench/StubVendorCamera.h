@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2012, The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+* @file StubVendorCamera.h
+*
+* A fake vendor camera module for running the wrapper off-device.
+*
+*/
+
+#ifndef STUB_VENDOR_CAMERA_H
+#define STUB_VENDOR_CAMERA_H
+
+#include <hardware/camera.h>
+#include <utils/Timers.h>
+
+/* hw_get_module returns this for "vendor-camera" */
+extern camera_module_t gStubVendorModule;
+
+/*
+ * Makes the stub sleep for usecs in the named op ("open" for the device
+ * open, otherwise a camera_device_ops field name). Returns -1 for an
+ * unknown op.
+ */
+int stub_vendor_set_delay(const char *op, unsigned int usecs);
+
+/* the ops table of a stub device, for calling the stub directly */
+camera_device_ops_t *stub_vendor_ops(void);
+
+/* the stub device opened last, i.e. the one under a just opened wrapper */
+camera_device_t *stub_vendor_last_opened(void);
+
+/*
+ * Delivers one frame of a stub device through its callbacks, data_cb_timestamp
+ * for CAMERA_MSG_VIDEO_FRAME and data_cb otherwise, whatever messages are
+ * enabled. Returns the frame's buffer, the opaque to release a recording
+ * frame with, or NULL without callbacks or memory.
+ */
+const void *stub_vendor_deliver_frame(camera_device_t *device, int32_t msg_type,
+        nsecs_t timestamp);
+
+#endif /* STUB_VENDOR_CAMERA_H */
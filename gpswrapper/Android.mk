@@ -7,10 +7,19 @@ LOCAL_MODULE := gps.$(TARGET_BOARD_PLATFORM)
 
 LOCAL_SHARED_LIBRARIES:= \
 	liblog \
-	libdl
+	libcutils \
+	libdl \
+	libm
 
 LOCAL_SRC_FILES += \
-    gps.c
+    gps.c \
+    gps_batch.c \
+    gps_dispatch.c \
+    gps_governor.c \
+    gps_nmea.c \
+    gps_refloc.c \
+    gps_stats.c \
+    gps_sv.c
 
 LOCAL_CFLAGS += \
     -fno-short-enums
@@ -19,3 +28,61 @@ LOCAL_PRELINK_MODULE := false
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 
 include $(BUILD_SHARED_LIBRARY)
+
+# stand-in for the vendor library on the build host, replays NMEA logs
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    bench/gps_replay_vendor.c
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/../overlay/include \
+    system/core/include
+
+LOCAL_STATIC_LIBRARIES := \
+    liblog
+
+LOCAL_LDLIBS := -lpthread -lrt -lm
+
+LOCAL_MODULE := gps_replay_vendor
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_SHARED_LIBRARY)
+
+# wrapper benchmark against the replay library:
+# LD_LIBRARY_PATH=out/host/<os>-x86/lib out/host/<os>-x86/bin/gps_wrapper_bench
+#     [-f nmea_log] [-s speed] [-l loops] [-e epochs] [-c callback_usecs]
+#     [-p property=value]... [-v]
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    gps.c \
+    gps_batch.c \
+    gps_dispatch.c \
+    gps_governor.c \
+    gps_nmea.c \
+    gps_refloc.c \
+    gps_stats.c \
+    gps_sv.c \
+    bench/gps_wrapper_bench.c
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/../overlay/include \
+    system/core/include
+
+# libcutils for the dispatch atomics; the bench's own property_get is
+# linked first, so the archive's properties object is never pulled in
+LOCAL_STATIC_LIBRARIES := \
+    libcutils \
+    liblog
+
+LOCAL_CFLAGS += \
+    -DORIGINAL_HAL_PATH=\"gps_replay_vendor.so\" \
+    -DGPS_REFLOC_PATH=\"/tmp/gps_wrapper_bench_refloc\"
+
+LOCAL_LDLIBS := -ldl -lpthread -lrt -lm
+
+LOCAL_MODULE := gps_wrapper_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,627 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * replay vendor library
+ *
+ * Stands in for the vendor GPS library on a build host. It implements
+ * GpsInterface like the real one does, but its fixes, satellites and NMEA
+ * sentences come from a recorded NMEA log: locations are taken from RMC
+ * and GGA, satellites from GSV and GSA, and every sentence is reported as
+ * well. Without a log a synthetic drive is generated.
+ *
+ * Configured through the environment, as it is loaded by the wrapper:
+ *   GPS_REPLAY_FILE    NMEA log to replay
+ *   GPS_REPLAY_SPEED   times real time, 0 replays as fast as possible (1)
+ *   GPS_REPLAY_LOOPS   times the log is replayed per session (1)
+ *   GPS_REPLAY_EPOCHS  length of the synthetic log in seconds (600)
+ *
+ * A session ends with GPS_STATUS_SESSION_END once the log is done.
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <hardware/hardware.h>
+#include <hardware/gps.h>
+
+#define LOG_TAG "gps-replay"
+#include <utils/Log.h>
+
+#define MAX_SENTENCE 128
+#define MAX_FIELDS 24
+
+typedef enum {
+    EVENT_NMEA,
+    EVENT_LOCATION,
+    EVENT_SV_STATUS
+} event_type_t;
+
+typedef struct {
+    event_type_t type;
+    /* since the start of the log */
+    int64_t time_ms;
+    GpsUtcTime timestamp;
+    char *nmea;
+    int nmea_len;
+    GpsLocation location;
+    GpsSvStatus *sv_status;
+} replay_event_t;
+
+static replay_event_t *events = NULL;
+static int numEvents = 0;
+static int maxEvents = 0;
+
+static GpsCallbacks callbacks;
+static pthread_mutex_t replayLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t replayCond = PTHREAD_COND_INITIALIZER;
+static pthread_t replayThread;
+static int running = 0;
+static int stopRequested = 0;
+static double replaySpeed = 1;
+static int replayLoops = 1;
+
+/* parser state, what the next RMC or the last GSV page needs */
+static int64_t baseTimeMs = -1;
+static int64_t epochTimeMs = 0;
+static GpsUtcTime epochTimestamp = 0;
+static double ggaAltitude = 0;
+static int haveAltitude = 0;
+static float ggaHdop = 0;
+static uint32_t usedMask = 0;
+static GpsSvStatus pendingSvs;
+
+static replay_event_t *add_event(event_type_t type)
+{
+    replay_event_t *event;
+
+    if (numEvents == maxEvents) {
+        int max = maxEvents ? maxEvents * 2 : 1024;
+        replay_event_t *grown = realloc(events, max * sizeof(*events));
+
+        if (!grown)
+            return NULL;
+        events = grown;
+        maxEvents = max;
+    }
+
+    event = &events[numEvents++];
+    memset(event, 0, sizeof(*event));
+    event->type = type;
+    event->time_ms = epochTimeMs;
+    event->timestamp = epochTimestamp;
+    return event;
+}
+
+/* splits a sentence in place, the checksum is dropped */
+static int split_fields(char *sentence, char **fields)
+{
+    int n = 0;
+    char *p = sentence;
+
+    while (n < MAX_FIELDS) {
+        fields[n++] = p;
+        p = strpbrk(p, ",*\r\n");
+        if (!p || *p != ',') {
+            if (p)
+                *p = 0;
+            break;
+        }
+        *p++ = 0;
+    }
+    return n;
+}
+
+static double nmea_degrees(const char *value, const char *hemisphere)
+{
+    double v = atof(value);
+    double degrees = floor(v / 100);
+
+    degrees += (v - degrees * 100) / 60;
+    if (*hemisphere == 'S' || *hemisphere == 'W')
+        degrees = -degrees;
+    return degrees;
+}
+
+/* hhmmss.sss to ms of the day */
+static int64_t nmea_time_ms(const char *value)
+{
+    double v = atof(value);
+    int hms = (int)v;
+
+    return ((int64_t)(hms / 10000) * 3600 + (hms / 100 % 100) * 60 + hms % 100) * 1000 +
+            (int64_t)((v - hms) * 1000 + 0.5);
+}
+
+static void set_epoch_time(const char *value)
+{
+    int64_t ms;
+
+    if (!*value)
+        return;
+    ms = nmea_time_ms(value);
+    if (baseTimeMs < 0)
+        baseTimeMs = ms;
+    ms -= baseTimeMs;
+    /* logs running over midnight */
+    while (ms < epochTimeMs - 12 * 3600 * 1000LL)
+        ms += 24 * 3600 * 1000LL;
+    epochTimeMs = ms;
+}
+
+static void parse_gga(char **f, int n)
+{
+    if (n < 10)
+        return;
+    ggaHdop = atof(f[8]);
+    haveAltitude = *f[9] != 0;
+    ggaAltitude = atof(f[9]);
+}
+
+static void parse_gsa(char **f, int n)
+{
+    int i;
+
+    usedMask = 0;
+    for (i = 3; i < 15 && i < n; i++) {
+        int prn = atoi(f[i]);
+
+        if (prn > 0 && prn <= 32)
+            usedMask |= 1u << (prn - 1);
+    }
+}
+
+static void parse_gsv(char **f, int n)
+{
+    int total, page, i;
+    replay_event_t *event;
+
+    if (n < 4)
+        return;
+    total = atoi(f[1]);
+    page = atoi(f[2]);
+    if (page == 1)
+        memset(&pendingSvs, 0, sizeof(pendingSvs));
+
+    for (i = 4; i + 3 < n && *f[i] && pendingSvs.num_svs < GPS_MAX_SVS; i += 4) {
+        GpsSvInfo *sv = &pendingSvs.sv_list[pendingSvs.num_svs++];
+
+        sv->size = sizeof(GpsSvInfo);
+        sv->prn = atoi(f[i]);
+        sv->elevation = atof(f[i + 1]);
+        sv->azimuth = atof(f[i + 2]);
+        sv->snr = atof(f[i + 3]);
+    }
+
+    if (page != total)
+        return;
+
+    pendingSvs.size = sizeof(GpsSvStatus);
+    pendingSvs.used_in_fix_mask = usedMask;
+    pendingSvs.ephemeris_mask = usedMask;
+    for (i = 0; i < pendingSvs.num_svs; i++) {
+        int prn = pendingSvs.sv_list[i].prn;
+
+        if (prn > 0 && prn <= 32)
+            pendingSvs.almanac_mask |= 1u << (prn - 1);
+    }
+
+    event = add_event(EVENT_SV_STATUS);
+    if (event && (event->sv_status = malloc(sizeof(GpsSvStatus))))
+        memcpy(event->sv_status, &pendingSvs, sizeof(GpsSvStatus));
+}
+
+static void parse_rmc(char **f, int n)
+{
+    replay_event_t *event;
+    GpsLocation *location;
+    struct tm tm;
+    int64_t day_ms;
+    int date;
+
+    if (n < 10)
+        return;
+
+    date = atoi(f[9]);
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_mday = date / 10000;
+    tm.tm_mon = date / 100 % 100 - 1;
+    tm.tm_year = date % 100 + 100;
+    day_ms = nmea_time_ms(f[1]);
+    epochTimestamp = (GpsUtcTime)timegm(&tm) * 1000 + day_ms;
+
+    if (*f[2] != 'A')
+        return;
+
+    event = add_event(EVENT_LOCATION);
+    if (!event)
+        return;
+    location = &event->location;
+    location->size = sizeof(GpsLocation);
+    location->flags = GPS_LOCATION_HAS_LAT_LONG;
+    location->latitude = nmea_degrees(f[3], f[4]);
+    location->longitude = nmea_degrees(f[5], f[6]);
+    if (*f[7]) {
+        location->flags |= GPS_LOCATION_HAS_SPEED;
+        location->speed = atof(f[7]) * 0.514444f;
+    }
+    if (*f[8]) {
+        location->flags |= GPS_LOCATION_HAS_BEARING;
+        location->bearing = atof(f[8]);
+    }
+    if (haveAltitude) {
+        location->flags |= GPS_LOCATION_HAS_ALTITUDE;
+        location->altitude = ggaAltitude;
+    }
+    if (ggaHdop > 0) {
+        location->flags |= GPS_LOCATION_HAS_ACCURACY;
+        location->accuracy = ggaHdop * 5;
+    }
+    location->timestamp = epochTimestamp;
+}
+
+static void parse_sentence(const char *line)
+{
+    char copy[MAX_SENTENCE];
+    char *fields[MAX_FIELDS];
+    const char *type;
+    replay_event_t *event;
+    int len = strcspn(line, "\r\n");
+    int n;
+
+    if (*line != '$' || len < 7 || len >= MAX_SENTENCE - 2)
+        return;
+
+    memcpy(copy, line, len);
+    copy[len] = 0;
+    n = split_fields(copy, fields);
+    type = fields[0] + 3;
+
+    /* the sentences carrying the time start an epoch */
+    if (n > 1 && (!strcmp(type, "GGA") || !strcmp(type, "RMC")))
+        set_epoch_time(fields[1]);
+
+    /* sentences are reported as the vendor does, with their line ending */
+    event = add_event(EVENT_NMEA);
+    if (!event || !(event->nmea = malloc(len + 3)))
+        return;
+    memcpy(event->nmea, line, len);
+    memcpy(event->nmea + len, "\r\n", 3);
+    event->nmea_len = len + 2;
+
+    if (!strcmp(type, "GGA"))
+        parse_gga(fields, n);
+    else if (!strcmp(type, "GSA"))
+        parse_gsa(fields, n);
+    else if (!strcmp(type, "GSV"))
+        parse_gsv(fields, n);
+    else if (!strcmp(type, "RMC"))
+        parse_rmc(fields, n);
+}
+
+static void add_sentence(char *buf, size_t size, const char *body)
+{
+    unsigned char sum = 0;
+    const char *p;
+
+    for (p = body; *p; p++)
+        sum ^= (unsigned char)*p;
+    snprintf(buf, size, "$%s*%02X", body, sum);
+    parse_sentence(buf);
+}
+
+static void nmea_coordinate(char *buf, size_t size, double degrees, int lat)
+{
+    double a = fabs(degrees);
+    int d = (int)a;
+
+    snprintf(buf, size, lat ? "%02d%07.4f,%c" : "%03d%07.4f,%c", d, (a - d) * 60,
+            lat ? (degrees < 0 ? 'S' : 'N') : (degrees < 0 ? 'W' : 'E'));
+}
+
+/* a drive around a 1km circle at 15m/s, 8 satellites moving slowly */
+static void generate_log(int seconds)
+{
+    char body[MAX_SENTENCE - 8], sentence[MAX_SENTENCE], lat[24], lon[24];
+    int t, s, page;
+
+    for (t = 0; t < seconds; t++) {
+        int hms = 120000 + (t / 3600) * 10000 + (t / 60 % 60) * 100 + t % 60;
+        double angle = t * 15.0 / 1000;
+        double latitude = 51.5 + 0.009 * sin(angle);
+        double longitude = -0.12 + 0.0144 * cos(angle);
+        double bearing = fmod(360 + 90 - angle * 180 / M_PI, 360);
+
+        nmea_coordinate(lat, sizeof(lat), latitude, 1);
+        nmea_coordinate(lon, sizeof(lon), longitude, 0);
+
+        snprintf(body, sizeof(body), "GPGGA,%06d.000,%s,%s,1,08,0.9,45.0,M,47.0,M,,",
+                hms, lat, lon);
+        add_sentence(sentence, sizeof(sentence), body);
+        add_sentence(sentence, sizeof(sentence),
+                "GPGSA,A,3,02,05,07,12,15,21,26,29,,,,,1.6,0.9,1.3");
+
+        for (page = 0; page < 2; page++) {
+            int len = snprintf(body, sizeof(body), "GPGSV,2,%d,08", page + 1);
+
+            for (s = page * 4; s < page * 4 + 4; s++) {
+                static const int prns[8] = { 2, 5, 7, 12, 15, 21, 26, 29 };
+                int snr = 30 + (int)(8 * sin(t / 20.0 + s));
+
+                len += snprintf(body + len, sizeof(body) - len, ",%02d,%02d,%03d,%02d",
+                        prns[s], 20 + s * 7 + t / 120 % 10, (s * 45 + t / 60) % 360, snr);
+            }
+            add_sentence(sentence, sizeof(sentence), body);
+        }
+
+        snprintf(body, sizeof(body), "GPRMC,%06d.000,A,%s,%s,29.2,%05.1f,010612,,,A",
+                hms, lat, lon, bearing);
+        add_sentence(sentence, sizeof(sentence), body);
+        snprintf(body, sizeof(body), "GPVTG,%05.1f,T,,M,29.2,N,54.0,K,A", bearing);
+        add_sentence(sentence, sizeof(sentence), body);
+    }
+}
+
+static int load_log(const char *path)
+{
+    char line[512];
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        LOGE("%s: cannot open %s: %s", __func__, path, strerror(errno));
+        return -errno;
+    }
+    while (fgets(line, sizeof(line), f))
+        parse_sentence(line);
+    fclose(f);
+    return 0;
+}
+
+static void free_events(void)
+{
+    int i;
+
+    for (i = 0; i < numEvents; i++) {
+        free(events[i].nmea);
+        free(events[i].sv_status);
+    }
+    free(events);
+    events = NULL;
+    numEvents = maxEvents = 0;
+    baseTimeMs = -1;
+    epochTimeMs = 0;
+}
+
+static void report_status(GpsStatusValue value)
+{
+    GpsStatus status;
+
+    status.size = sizeof(GpsStatus);
+    status.status = value;
+    if (callbacks.status_cb)
+        callbacks.status_cb(&status);
+}
+
+/* waits until time_ms of the log is due, returns 0 if stop was requested */
+static int wait_until(const struct timespec *start, int64_t time_ms)
+{
+    struct timespec deadline;
+    int64_t ns;
+    int ret;
+
+    pthread_mutex_lock(&replayLock);
+    if (replaySpeed > 0 && !stopRequested) {
+        ns = (int64_t)(time_ms * 1000000 / replaySpeed);
+        deadline.tv_sec = start->tv_sec + ns / 1000000000;
+        deadline.tv_nsec = start->tv_nsec + ns % 1000000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while (!stopRequested) {
+            ret = pthread_cond_timedwait(&replayCond, &replayLock, &deadline);
+            if (ret == ETIMEDOUT)
+                break;
+        }
+    }
+    ret = !stopRequested;
+    pthread_mutex_unlock(&replayLock);
+    return ret;
+}
+
+static void replay_thread(void *arg)
+{
+    struct timespec start;
+    int loop, i;
+
+    report_status(GPS_STATUS_SESSION_BEGIN);
+
+    for (loop = 0; loop < replayLoops; loop++) {
+        /* pthread_cond_timedwait uses the realtime clock */
+        clock_gettime(CLOCK_REALTIME, &start);
+
+        for (i = 0; i < numEvents; i++) {
+            replay_event_t *event = &events[i];
+
+            if (!wait_until(&start, event->time_ms))
+                goto done;
+
+            switch (event->type) {
+            case EVENT_NMEA:
+                if (callbacks.nmea_cb)
+                    callbacks.nmea_cb(event->timestamp, event->nmea, event->nmea_len);
+                break;
+            case EVENT_LOCATION:
+                if (callbacks.location_cb)
+                    callbacks.location_cb(&event->location);
+                break;
+            case EVENT_SV_STATUS:
+                if (callbacks.sv_status_cb)
+                    callbacks.sv_status_cb(event->sv_status);
+                break;
+            }
+        }
+    }
+
+done:
+    report_status(GPS_STATUS_SESSION_END);
+}
+
+static int replay_init(GpsCallbacks *cb)
+{
+    const char *value;
+
+    memset(&callbacks, 0, sizeof(callbacks));
+    memcpy(&callbacks, cb, cb->size < sizeof(callbacks) ? cb->size : sizeof(callbacks));
+
+    free_events();
+    value = getenv("GPS_REPLAY_FILE");
+    if (value && *value) {
+        if (load_log(value))
+            return -1;
+    } else {
+        value = getenv("GPS_REPLAY_EPOCHS");
+        generate_log(value ? atoi(value) : 600);
+    }
+
+    value = getenv("GPS_REPLAY_SPEED");
+    replaySpeed = value ? atof(value) : 1;
+    value = getenv("GPS_REPLAY_LOOPS");
+    replayLoops = value ? atoi(value) : 1;
+
+    LOGI("%s: %d events, speed %g, %d loops", __func__, numEvents, replaySpeed, replayLoops);
+    return 0;
+}
+
+static int replay_start(void)
+{
+    if (running)
+        return 0;
+    if (!callbacks.create_thread_cb)
+        return -1;
+
+    stopRequested = 0;
+    replayThread = callbacks.create_thread_cb("gps-replay", replay_thread, NULL);
+    running = 1;
+    return 0;
+}
+
+static int replay_stop(void)
+{
+    if (!running)
+        return 0;
+
+    pthread_mutex_lock(&replayLock);
+    stopRequested = 1;
+    pthread_cond_broadcast(&replayCond);
+    pthread_mutex_unlock(&replayLock);
+
+    pthread_join(replayThread, NULL);
+    running = 0;
+    return 0;
+}
+
+static void replay_cleanup(void)
+{
+    replay_stop();
+    free_events();
+}
+
+static int replay_inject_time(GpsUtcTime time, int64_t timeReference, int uncertainty)
+{
+    return 0;
+}
+
+static int replay_inject_location(double latitude, double longitude, float accuracy)
+{
+    return 0;
+}
+
+static void replay_delete_aiding_data(GpsAidingData flags)
+{
+}
+
+static int replay_set_position_mode(GpsPositionMode mode, GpsPositionRecurrence recurrence,
+        uint32_t min_interval, uint32_t preferred_accuracy, uint32_t preferred_time)
+{
+    return 0;
+}
+
+static const void* replay_get_extension(const char* name)
+{
+    return NULL;
+}
+
+static const GpsInterface replayInterface = {
+    .size = sizeof(GpsInterface),
+    .init = replay_init,
+    .start = replay_start,
+    .stop = replay_stop,
+    .cleanup = replay_cleanup,
+    .inject_time = replay_inject_time,
+    .inject_location = replay_inject_location,
+    .delete_aiding_data = replay_delete_aiding_data,
+    .set_position_mode = replay_set_position_mode,
+    .get_extension = replay_get_extension,
+};
+
+static const GpsInterface* replay_get_gps_interface(struct gps_device_t* dev)
+{
+    return &replayInterface;
+}
+
+static int replay_close(struct hw_device_t* device)
+{
+    free(device);
+    return 0;
+}
+
+static int replay_open(const struct hw_module_t* module, char const* name,
+        struct hw_device_t** device)
+{
+    struct gps_device_t *dev = calloc(1, sizeof(struct gps_device_t));
+
+    if (!dev)
+        return -ENOMEM;
+
+    dev->common.tag = HARDWARE_DEVICE_TAG;
+    dev->common.module = (struct hw_module_t*)module;
+    dev->common.close = replay_close;
+    dev->get_gps_interface = replay_get_gps_interface;
+
+    *device = (struct hw_device_t*)dev;
+    return 0;
+}
+
+static struct hw_module_methods_t replay_module_methods = {
+    .open = replay_open
+};
+
+/* not const, the loader stores the dlopen handle in it */
+struct hw_module_t HAL_MODULE_INFO_SYM = {
+    .tag = HARDWARE_MODULE_TAG,
+    .version_major = 1,
+    .version_minor = 0,
+    .id = GPS_HARDWARE_MODULE_ID,
+    .name = "GPS Replay Module",
+    .author = "The CyanogenMod Project",
+    .methods = &replay_module_methods,
+};
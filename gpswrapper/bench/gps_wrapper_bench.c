@@ -0,0 +1,396 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * host benchmark
+ *
+ * Runs the wrapper on a build host against the replay vendor library,
+ * which it loads through its usual load() path, and plays the framework:
+ * counts what arrives on each callback, optionally spending a fixed time
+ * in every callback like system_server's JNI does. The same log is also
+ * replayed with the replay library loaded directly, and through the
+ * wrapper with everything it does turned off, so the difference between
+ * the runs is the wrapper's own cost and what it saves.
+ *
+ * usage: gps_wrapper_bench [-f nmea_log] [-s speed] [-l loops] [-e epochs]
+ *                          [-c callback_usecs] [-p property=value]... [-v]
+ *
+ * The -p properties apply to the last run, on top of the wrapper defaults.
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hardware/hardware.h>
+#include <hardware/gps.h>
+#include <cutils/properties.h>
+
+#define MAX_PROPERTIES 32
+#define DEBUG_STATE_SIZE 8192
+
+typedef struct {
+    const char *key;
+    const char *value;
+} property_t;
+
+typedef struct {
+    const char *name;
+    /* the replay library without the wrapper */
+    int direct;
+    const property_t *properties;
+} bench_run_t;
+
+typedef struct {
+    uint32_t calls[4];
+    uint64_t nmea_bytes;
+    int64_t last_location_us;
+    int64_t max_location_gap_us;
+} bench_counts_t;
+
+/* the wrapper */
+extern const struct hw_module_t HAL_MODULE_INFO_SYM;
+
+static const property_t passThroughProperties[] = {
+    { "persist.gps.batch.interval_ms", "0" },
+    { "persist.gps.batch.distance_m", "0" },
+    { "persist.gps.nmea.mode", "pass" },
+    { "persist.gps.sv.snr_db", "0" },
+    { "persist.gps.sv.elevation_deg", "0" },
+    { "persist.gps.sv.azimuth_deg", "0" },
+    { "persist.gps.refloc.fix_max_age_s", "0" },
+    { "persist.gps.refloc.ref_max_age_s", "0" },
+    { "persist.gps.governor.interval_ms", "0" },
+    { "persist.gps.dispatch.enable", "0" },
+    { NULL, NULL }
+};
+
+static property_t userProperties[MAX_PROPERTIES + 1];
+static int numUserProperties = 0;
+static const property_t *activeProperties = NULL;
+
+static pthread_mutex_t benchLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t benchCond = PTHREAD_COND_INITIALIZER;
+static int sessionEnded = 0;
+static bench_counts_t counts;
+static int callbackUs = 0;
+
+/* the wrapper reads its settings through this */
+int property_get(const char *key, char *value, const char *default_value)
+{
+    const property_t *p;
+
+    for (p = activeProperties; p && p->key; p++) {
+        if (!strcmp(p->key, key)) {
+            default_value = p->value;
+            break;
+        }
+    }
+    strncpy(value, default_value ? default_value : "", PROPERTY_VALUE_MAX - 1);
+    value[PROPERTY_VALUE_MAX - 1] = 0;
+    return strlen(value);
+}
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t cpu_us(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+            usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* what a JNI call into system_server costs, roughly */
+static void spend_callback_time(void)
+{
+    int64_t end;
+
+    if (!callbackUs)
+        return;
+    end = now_us() + callbackUs;
+    while (now_us() < end)
+        ;
+}
+
+static void bench_location_cb(GpsLocation *location)
+{
+    int64_t now = now_us();
+
+    pthread_mutex_lock(&benchLock);
+    counts.calls[0]++;
+    if (counts.last_location_us && now - counts.last_location_us > counts.max_location_gap_us)
+        counts.max_location_gap_us = now - counts.last_location_us;
+    counts.last_location_us = now;
+    pthread_mutex_unlock(&benchLock);
+    spend_callback_time();
+}
+
+static void bench_status_cb(GpsStatus *status)
+{
+    pthread_mutex_lock(&benchLock);
+    counts.calls[1]++;
+    if (status->status == GPS_STATUS_SESSION_END) {
+        sessionEnded = 1;
+        pthread_cond_broadcast(&benchCond);
+    }
+    pthread_mutex_unlock(&benchLock);
+    spend_callback_time();
+}
+
+static void bench_sv_status_cb(GpsSvStatus *sv_info)
+{
+    pthread_mutex_lock(&benchLock);
+    counts.calls[2]++;
+    pthread_mutex_unlock(&benchLock);
+    spend_callback_time();
+}
+
+static void bench_nmea_cb(GpsUtcTime timestamp, const char *nmea, int length)
+{
+    pthread_mutex_lock(&benchLock);
+    counts.calls[3]++;
+    counts.nmea_bytes += length;
+    pthread_mutex_unlock(&benchLock);
+    spend_callback_time();
+}
+
+static void bench_set_capabilities_cb(uint32_t capabilities)
+{
+}
+
+static void bench_acquire_wakelock_cb(void)
+{
+}
+
+static void bench_release_wakelock_cb(void)
+{
+}
+
+typedef struct {
+    void (*start)(void *);
+    void *arg;
+} thread_start_t;
+
+static void *thread_main(void *arg)
+{
+    thread_start_t start = *(thread_start_t *)arg;
+
+    free(arg);
+    start.start(start.arg);
+    return NULL;
+}
+
+static pthread_t bench_create_thread_cb(const char *name, void (*start)(void *), void *arg)
+{
+    thread_start_t *s = malloc(sizeof(*s));
+    pthread_t thread;
+
+    s->start = start;
+    s->arg = arg;
+    if (pthread_create(&thread, NULL, thread_main, s)) {
+        free(s);
+        return 0;
+    }
+    /* like the framework's java threads, nobody joins these */
+    pthread_detach(thread);
+    return thread;
+}
+
+static void bench_request_utc_time_cb(void)
+{
+}
+
+static GpsCallbacks benchCallbacks = {
+    .size = sizeof(GpsCallbacks),
+    .location_cb = bench_location_cb,
+    .status_cb = bench_status_cb,
+    .sv_status_cb = bench_sv_status_cb,
+    .nmea_cb = bench_nmea_cb,
+    .set_capabilities_cb = bench_set_capabilities_cb,
+    .acquire_wakelock_cb = bench_acquire_wakelock_cb,
+    .release_wakelock_cb = bench_release_wakelock_cb,
+    .create_thread_cb = bench_create_thread_cb,
+    .request_utc_time_cb = bench_request_utc_time_cb,
+};
+
+static const GpsInterface *open_interface(const struct hw_module_t *module)
+{
+    struct hw_device_t *device;
+
+    if (module->methods->open(module, GPS_HARDWARE_MODULE_ID, &device))
+        return NULL;
+    return ((struct gps_device_t *)device)->get_gps_interface((struct gps_device_t *)device);
+}
+
+static const GpsInterface *load_direct(void)
+{
+    const struct hw_module_t *module;
+    void *handle = dlopen(ORIGINAL_HAL_PATH, RTLD_NOW);
+
+    if (!handle) {
+        fprintf(stderr, "cannot load %s: %s\n", ORIGINAL_HAL_PATH, dlerror());
+        return NULL;
+    }
+    module = dlsym(handle, HAL_MODULE_INFO_SYM_AS_STR);
+    return module ? open_interface(module) : NULL;
+}
+
+static int run(const bench_run_t *r, const bench_counts_t *baseline, int verbose)
+{
+    const GpsInterface *gps;
+    int64_t start_us, start_cpu, elapsed_us, cpu;
+    uint32_t total;
+
+    activeProperties = r->properties;
+    gps = r->direct ? load_direct() : open_interface(&HAL_MODULE_INFO_SYM);
+    if (!gps) {
+        fprintf(stderr, "%s: no GPS interface\n", r->name);
+        return -1;
+    }
+
+    memset(&counts, 0, sizeof(counts));
+    sessionEnded = 0;
+    if (gps->init(&benchCallbacks)) {
+        fprintf(stderr, "%s: init failed\n", r->name);
+        return -1;
+    }
+    gps->set_position_mode(GPS_POSITION_MODE_STANDALONE,
+            GPS_POSITION_RECURRENCE_PERIODIC, 1000, 0, 0);
+
+    start_us = now_us();
+    start_cpu = cpu_us();
+    gps->start();
+
+    pthread_mutex_lock(&benchLock);
+    while (!sessionEnded)
+        pthread_cond_wait(&benchCond, &benchLock);
+    pthread_mutex_unlock(&benchLock);
+
+    /*
+     * stop flushes whatever the wrapper still holds, cleanup waits for
+     * the dispatch thread to deliver it
+     */
+    gps->stop();
+    gps->cleanup();
+    elapsed_us = now_us() - start_us;
+    cpu = cpu_us() - start_cpu;
+
+    total = counts.calls[0] + counts.calls[1] + counts.calls[2] + counts.calls[3];
+    printf("%s:\n", r->name);
+    printf("  location %u, status %u, sv_status %u, nmea %u (%llu bytes), %u callbacks\n",
+            counts.calls[0], counts.calls[1], counts.calls[2], counts.calls[3],
+            (unsigned long long)counts.nmea_bytes, total);
+    printf("  wall %lldms, cpu %lldms, longest gap between locations %lldms\n",
+            (long long)(elapsed_us / 1000), (long long)(cpu / 1000),
+            (long long)(counts.max_location_gap_us / 1000));
+    if (baseline) {
+        uint32_t vendor = baseline->calls[0] + baseline->calls[1] +
+                baseline->calls[2] + baseline->calls[3];
+
+        printf("  %.0fns cpu per vendor callback\n", vendor ? cpu * 1000.0 / vendor : 0);
+    }
+
+    if (verbose && !r->direct) {
+        const GpsDebugInterface *debug = gps->get_extension(GPS_DEBUG_INTERFACE);
+        char state[DEBUG_STATE_SIZE];
+
+        if (debug) {
+            size_t len = debug->get_internal_state(state, sizeof(state));
+
+            fwrite(state, 1, len, stdout);
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-f nmea_log] [-s speed] [-l loops] [-e epochs]\n"
+            "       [-c callback_usecs] [-p property=value]... [-v]\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    bench_counts_t baseline;
+    bench_run_t runs[3] = {
+        { "vendor library alone", 1, NULL },
+        { "wrapper, pass-through", 0, passThroughProperties },
+        { "wrapper", 0, userProperties },
+    };
+    int verbose = 0;
+    int opt, i;
+
+    /* as fast as possible, unless asked otherwise */
+    setenv("GPS_REPLAY_SPEED", "0", 1);
+
+    while ((opt = getopt(argc, argv, "f:s:l:e:c:p:v")) != -1) {
+        switch (opt) {
+        case 'f':
+            setenv("GPS_REPLAY_FILE", optarg, 1);
+            break;
+        case 's':
+            setenv("GPS_REPLAY_SPEED", optarg, 1);
+            break;
+        case 'l':
+            setenv("GPS_REPLAY_LOOPS", optarg, 1);
+            break;
+        case 'e':
+            setenv("GPS_REPLAY_EPOCHS", optarg, 1);
+            break;
+        case 'c':
+            callbackUs = atoi(optarg);
+            break;
+        case 'p': {
+            char *eq = strchr(optarg, '=');
+
+            if (!eq || numUserProperties == MAX_PROPERTIES)
+                usage(argv[0]);
+            *eq = 0;
+            userProperties[numUserProperties].key = optarg;
+            userProperties[numUserProperties].value = eq + 1;
+            numUserProperties++;
+            break;
+        }
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (run(&runs[i], i ? &baseline : NULL, verbose))
+            return 1;
+        if (!i)
+            baseline = counts;
+    }
+    return 0;
+}
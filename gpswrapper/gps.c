@@ -24,21 +24,88 @@
 #include <hardware/gps.h>
 #include <errno.h>
 #include <dlfcn.h>
+#include <string.h>
+#include <pthread.h>
 
 //#define LOG_NDEBUG 0
 
 #include <stdlib.h>
 #define LOG_TAG "gps-wrapper"
 #include <utils/Log.h>
+#include <cutils/properties.h>
 
+#include "gps_batch.h"
+#include "gps_dispatch.h"
+#include "gps_governor.h"
+#include "gps_nmea.h"
+#include "gps_refloc.h"
+#include "gps_stats.h"
+#include "gps_sv.h"
+
+/* the host benchmark points this at its replay library */
+#ifndef ORIGINAL_HAL_PATH
 #define ORIGINAL_HAL_PATH "/system/lib/hw/vendor-gps.exynos4.so"
+#endif
 
 static const AGpsRilInterface* oldAGPSRIL = NULL;
 static AGpsRilInterface newAGPSRIL;
+/* the vendor takes reference locations only after the framework's init */
+static int agpsRilInitialized = 0;
 
 static const GpsInterface* originalGpsInterface = NULL;
 static GpsInterface newGpsInterface;
 
+/* the vendor library is loaded and opened once, by the first user */
+static pthread_once_t vendorOnce = PTHREAD_ONCE_INIT;
+
+/* vendor extensions looked up so far, the framework asks more than once */
+#define MAX_EXTENSIONS 8
+
+static pthread_mutex_t extensionLock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    const char *name;
+    const void *extension;
+} vendorExtensions[MAX_EXTENSIONS];
+static int numVendorExtensions = 0;
+
+/* the framework's callbacks, the vendor gets ours */
+static GpsCallbacks frameworkCallbacks;
+static GpsCallbacks wrapperCallbacks;
+
+/* location batching, both 0 (the default) delivers every fix at once */
+#define BATCH_INTERVAL_PROPERTY "persist.gps.batch.interval_ms"
+#define BATCH_DISTANCE_PROPERTY "persist.gps.batch.distance_m"
+
+/* NMEA forwarding: "epoch" (the default), "pass" or "off" */
+#define NMEA_MODE_PROPERTY "persist.gps.nmea.mode"
+#define NMEA_INTERVAL_PROPERTY "persist.gps.nmea.min_interval_ms"
+
+/* SV status changes worth forwarding, all 0 forwards every report */
+#define SV_SNR_PROPERTY "persist.gps.sv.snr_db"
+#define SV_ELEVATION_PROPERTY "persist.gps.sv.elevation_deg"
+#define SV_AZIMUTH_PROPERTY "persist.gps.sv.azimuth_deg"
+#define SV_INTERVAL_PROPERTY "persist.gps.sv.max_interval_ms"
+
+/* how old a cached fix or cell reference may be to be injected on start */
+#define REFLOC_FIX_AGE_PROPERTY "persist.gps.refloc.fix_max_age_s"
+#define REFLOC_REF_AGE_PROPERTY "persist.gps.refloc.ref_max_age_s"
+
+/*
+ * fix interval while stationary, 0 always uses the requested one. Keep it
+ * well under the 10s after which GpsLocationProvider reports the provider
+ * temporarily unavailable.
+ */
+#define GOVERNOR_INTERVAL_PROPERTY "persist.gps.governor.interval_ms"
+#define GOVERNOR_SPEED_PROPERTY "persist.gps.governor.speed_cms"
+#define GOVERNOR_DISTANCE_PROPERTY "persist.gps.governor.distance_m"
+#define GOVERNOR_FIXES_PROPERTY "persist.gps.governor.fixes"
+
+/* callbacks reach the framework from a thread of the wrapper, 0 turns it off */
+#define DISPATCH_PROPERTY "persist.gps.dispatch.enable"
+/* full queue policies, "drop_oldest" (the default) or "drop_newest" */
+#define DISPATCH_SV_POLICY_PROPERTY "persist.gps.dispatch.sv_policy"
+#define DISPATCH_NMEA_POLICY_PROPERTY "persist.gps.dispatch.nmea_policy"
+
 /**
  * Load the file defined by the variant and if successful
  * return the dlopen handle and the hmi.
@@ -108,34 +175,334 @@ static void update_network_state_wrapper(int connected, int type, int roaming, c
     LOGI("%s was called and saved your from a faulty implementation ;-)", __func__);
 }
 
+static const void* vendor_extension(const char* name)
+{
+    const void* extension;
+    int i;
+
+    pthread_mutex_lock(&extensionLock);
+    for (i = 0; i < numVendorExtensions; i++) {
+        if (!strcmp(vendorExtensions[i].name, name)) {
+            extension = vendorExtensions[i].extension;
+            pthread_mutex_unlock(&extensionLock);
+            return extension;
+        }
+    }
+
+    extension = originalGpsInterface->get_extension(name);
+    /* names are the framework's string constants, they stay around */
+    if (numVendorExtensions < MAX_EXTENSIONS) {
+        vendorExtensions[numVendorExtensions].name = name;
+        vendorExtensions[numVendorExtensions].extension = extension;
+        numVendorExtensions++;
+    }
+    pthread_mutex_unlock(&extensionLock);
+    return extension;
+}
+
+/* ends a dump the framework's buffer was too small for */
+#define DUMP_TRUNCATED "wrapper.truncated=1\n"
+
+typedef size_t (*dump_func_t)(char *buffer, size_t size);
+
+static const dump_func_t wrapperDumps[] = {
+    gps_stats_dump,
+    gps_nmea_dump,
+    gps_sv_dump,
+    gps_refloc_dump,
+    gps_governor_dump,
+    gps_dispatch_dump,
+};
+
+/*
+ * The framework reads about 2KB. The vendor's state goes first, in at
+ * most half of it, then our sections as far as they fit; a cut dump ends
+ * with the marker, for which room is always kept.
+ */
+static size_t wrapper_get_internal_state(char* buffer, size_t bufferSize)
+{
+    const GpsDebugInterface* vendorDebug;
+    size_t room, vendorRoom, len = 0, n;
+    int truncated = 0;
+    unsigned int i;
+
+    if (bufferSize <= sizeof(DUMP_TRUNCATED))
+        return 0;
+    room = bufferSize - (sizeof(DUMP_TRUNCATED) - 1);
+
+    vendorDebug = vendor_extension(GPS_DEBUG_INTERFACE);
+    vendorRoom = room / 2;
+    if (vendorDebug && vendorRoom > 1) {
+        /* vendors may return what they wanted to write, like snprintf */
+        n = vendorDebug->get_internal_state(buffer, vendorRoom);
+        if (n >= vendorRoom) {
+            n = vendorRoom - 1;
+            truncated = 1;
+        }
+        len = n;
+        buffer[len] = 0;
+    }
+
+    for (i = 0; i < sizeof(wrapperDumps) / sizeof(wrapperDumps[0]) && !truncated; i++) {
+        len += wrapperDumps[i](buffer + len, room - len);
+        /* the dumps stop one short of the end when they are cut */
+        if (len >= room - 1)
+            truncated = 1;
+    }
+
+    if (truncated) {
+        /* drop the partial line */
+        while (len && buffer[len - 1] != '\n')
+            len--;
+        strcpy(buffer + len, DUMP_TRUNCATED);
+        len += sizeof(DUMP_TRUNCATED) - 1;
+    }
+    return len;
+}
+
+static void wrapper_agps_ril_init(AGpsRilCallbacks* callbacks)
+{
+    LOGV("%s was called", __func__);
+
+    oldAGPSRIL->init(callbacks);
+    agpsRilInitialized = 1;
+}
+
+static void wrapper_set_ref_location(const AGpsRefLocation *agps_reflocation, size_t sz_struct)
+{
+    LOGV("%s was called", __func__);
+
+    /* kept for the next cold start */
+    gps_refloc_set_ref_location(agps_reflocation, sz_struct);
+    oldAGPSRIL->set_ref_location(agps_reflocation, sz_struct);
+}
+
+static const GpsDebugInterface wrapperDebug = {
+    .size = sizeof(GpsDebugInterface),
+    .get_internal_state = wrapper_get_internal_state,
+};
+
 static const void* wrapper_get_extension(const char* name)
 {
     LOGV("%s was called", __func__);
+
+    if (!strcmp(name, GPS_DEBUG_INTERFACE))
+        return &wrapperDebug;
     
-    if (!strcmp(name, AGPS_RIL_INTERFACE) && (oldAGPSRIL = originalGpsInterface->get_extension(name)))
+    if (!strcmp(name, AGPS_RIL_INTERFACE) && (oldAGPSRIL = vendor_extension(name)))
     {
         LOGV("%s AGPS_RIL_INTERFACE extension requested", __func__);
         /* use a wrapper to avoid calling samsungs faulty implemetation */        
         newAGPSRIL.size = sizeof(AGpsRilInterface);
-        newAGPSRIL.init = oldAGPSRIL->init;
-        newAGPSRIL.set_ref_location = oldAGPSRIL->set_ref_location;
+        newAGPSRIL.init = wrapper_agps_ril_init;
+        newAGPSRIL.set_ref_location = wrapper_set_ref_location;
         newAGPSRIL.set_set_id = oldAGPSRIL->set_set_id;
         newAGPSRIL.ni_message = oldAGPSRIL->ni_message;
         LOGV("%s setting update_network_state_wrapper", __func__);
         newAGPSRIL.update_network_state = update_network_state_wrapper;
         return &newAGPSRIL;
     }
-    return originalGpsInterface->get_extension(name);
+    return vendor_extension(name);
+}
+
+static uint32_t get_uint_property(const char *key, const char *default_value)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get(key, value, default_value);
+    return strtoul(value, NULL, 10);
+}
+
+/* the framework's callbacks, timed, called on the dispatch thread if it runs */
+static void deliver_location(GpsLocation* location)
+{
+    int64_t start = gps_stats_now_us();
+
+    frameworkCallbacks.location_cb(location);
+    gps_stats_framework(GPS_CB_LOCATION, gps_stats_now_us() - start);
+}
+
+static void wrapper_location_cb(GpsLocation* location)
+{
+    int64_t now = gps_stats_now_us();
+
+    gps_stats_arrival(GPS_CB_LOCATION, now);
+    gps_stats_location(location, now);
+    gps_refloc_location(location);
+    gps_governor_location(location);
+    gps_batch_location(location);
+}
+
+static void deliver_status(GpsStatus* status)
+{
+    int64_t start = gps_stats_now_us();
+
+    frameworkCallbacks.status_cb(status);
+    gps_stats_framework(GPS_CB_STATUS, gps_stats_now_us() - start);
+}
+
+static void wrapper_status_cb(GpsStatus* status)
+{
+    gps_stats_arrival(GPS_CB_STATUS, gps_stats_now_us());
+    /* held back fixes and sentences belong before the session end */
+    if (status->status == GPS_STATUS_SESSION_END) {
+        gps_batch_flush();
+        gps_nmea_flush();
+    }
+    gps_dispatch_status(status);
+}
+
+static void deliver_sv_status(GpsSvStatus* sv_info)
+{
+    int64_t start = gps_stats_now_us();
+
+    frameworkCallbacks.sv_status_cb(sv_info);
+    gps_stats_framework(GPS_CB_SV_STATUS, gps_stats_now_us() - start);
+}
+
+static void wrapper_sv_status_cb(GpsSvStatus* sv_info)
+{
+    gps_stats_arrival(GPS_CB_SV_STATUS, gps_stats_now_us());
+    gps_sv_status(sv_info);
+}
+
+static void deliver_nmea(GpsUtcTime timestamp, const char* nmea, int length)
+{
+    int64_t start = gps_stats_now_us();
+
+    frameworkCallbacks.nmea_cb(timestamp, nmea, length);
+    gps_stats_framework(GPS_CB_NMEA, gps_stats_now_us() - start);
+}
+
+static void wrapper_nmea_cb(GpsUtcTime timestamp, const char* nmea, int length)
+{
+    gps_stats_arrival(GPS_CB_NMEA, gps_stats_now_us());
+    gps_nmea_sentence(timestamp, nmea, length);
+}
+
+static int wrapper_init(GpsCallbacks* callbacks)
+{
+    char mode[PROPERTY_VALUE_MAX];
+    char svPolicy[PROPERTY_VALUE_MAX];
+    char nmeaPolicy[PROPERTY_VALUE_MAX];
+    gps_dispatch_callbacks_t dispatchCallbacks;
+
+    LOGV("%s was called", __func__);
+
+    memset(&frameworkCallbacks, 0, sizeof(frameworkCallbacks));
+    memcpy(&frameworkCallbacks, callbacks,
+            callbacks->size < sizeof(GpsCallbacks) ? callbacks->size : sizeof(GpsCallbacks));
+
+    wrapperCallbacks = frameworkCallbacks;
+    wrapperCallbacks.size = sizeof(GpsCallbacks);
+    if (frameworkCallbacks.location_cb)
+        wrapperCallbacks.location_cb = wrapper_location_cb;
+    if (frameworkCallbacks.status_cb)
+        wrapperCallbacks.status_cb = wrapper_status_cb;
+    if (frameworkCallbacks.sv_status_cb)
+        wrapperCallbacks.sv_status_cb = wrapper_sv_status_cb;
+    if (frameworkCallbacks.nmea_cb)
+        wrapperCallbacks.nmea_cb = wrapper_nmea_cb;
+
+    /* properties are read here, changes apply from the next GPS enable */
+    gps_batch_configure(gps_dispatch_location,
+            get_uint_property(BATCH_INTERVAL_PROPERTY, "0"),
+            get_uint_property(BATCH_DISTANCE_PROPERTY, "0"));
+    property_get(NMEA_MODE_PROPERTY, mode, "epoch");
+    gps_nmea_configure(gps_dispatch_nmea, gps_nmea_parse_mode(mode),
+            get_uint_property(NMEA_INTERVAL_PROPERTY, "0"));
+    gps_sv_configure(gps_dispatch_sv_status,
+            get_uint_property(SV_SNR_PROPERTY, "2"),
+            get_uint_property(SV_ELEVATION_PROPERTY, "1"),
+            get_uint_property(SV_AZIMUTH_PROPERTY, "2"),
+            get_uint_property(SV_INTERVAL_PROPERTY, "5000"));
+    gps_refloc_configure(GPS_REFLOC_PATH,
+            get_uint_property(REFLOC_FIX_AGE_PROPERTY, "7200"),
+            get_uint_property(REFLOC_REF_AGE_PROPERTY, "3600"));
+    gps_governor_configure(originalGpsInterface,
+            get_uint_property(GOVERNOR_INTERVAL_PROPERTY, "5000"),
+            get_uint_property(GOVERNOR_SPEED_PROPERTY, "50"),
+            get_uint_property(GOVERNOR_DISTANCE_PROPERTY, "25"),
+            get_uint_property(GOVERNOR_FIXES_PROPERTY, "5"));
+
+    dispatchCallbacks.location_cb = deliver_location;
+    dispatchCallbacks.status_cb = deliver_status;
+    dispatchCallbacks.sv_status_cb = deliver_sv_status;
+    dispatchCallbacks.nmea_cb = deliver_nmea;
+    dispatchCallbacks.acquire_wakelock_cb = frameworkCallbacks.acquire_wakelock_cb;
+    dispatchCallbacks.release_wakelock_cb = frameworkCallbacks.release_wakelock_cb;
+    property_get(DISPATCH_SV_POLICY_PROPERTY, svPolicy, "drop_oldest");
+    property_get(DISPATCH_NMEA_POLICY_PROPERTY, nmeaPolicy, "drop_oldest");
+    gps_dispatch_start(&dispatchCallbacks, frameworkCallbacks.create_thread_cb,
+            get_uint_property(DISPATCH_PROPERTY, "1"),
+            gps_dispatch_parse_policy(svPolicy, GPS_DISPATCH_DROP_OLDEST),
+            gps_dispatch_parse_policy(nmeaPolicy, GPS_DISPATCH_DROP_OLDEST));
+
+    return originalGpsInterface->init(&wrapperCallbacks);
+}
+
+static int wrapper_set_position_mode(GpsPositionMode mode, GpsPositionRecurrence recurrence,
+        uint32_t min_interval, uint32_t preferred_accuracy, uint32_t preferred_time)
+{
+    LOGV("%s was called, interval %ums", __func__, min_interval);
+
+    return gps_governor_set_position_mode(mode, recurrence, min_interval,
+            preferred_accuracy, preferred_time);
+}
+
+static int wrapper_start(void)
+{
+    int injected;
+
+    LOGV("%s was called", __func__);
+
+    /* give a cold engine a starting point */
+    injected = gps_refloc_inject(originalGpsInterface,
+            agpsRilInitialized ? oldAGPSRIL : NULL);
+
+    gps_stats_start(injected);
+    gps_governor_start();
+    /* the first fix and satellites of a session are always shown */
+    gps_batch_start();
+    gps_sv_reset();
+    return originalGpsInterface->start();
+}
+
+static int wrapper_stop(void)
+{
+    int ret;
+
+    LOGV("%s was called", __func__);
+
+    ret = originalGpsInterface->stop();
+    gps_governor_stop();
+    gps_stats_stop();
+    /* no more fixes are coming, do not sit on the last ones */
+    gps_batch_flush();
+    gps_nmea_flush();
+    gps_refloc_save();
+    return ret;
+}
+
+static void wrapper_cleanup(void)
+{
+    LOGV("%s was called", __func__);
+
+    originalGpsInterface->cleanup();
+    gps_batch_flush();
+    gps_nmea_flush();
+    /* after the flushes, so what they deliver still goes out */
+    gps_dispatch_stop();
 }
 
 /* HAL Methods */
-const GpsInterface* gps_get_gps_interface(struct gps_device_t* dev)
+static void load_vendor(void)
 {
     hw_module_t* module;
     int err;
-    
-	LOGV("%s was called", __func__);    
-    
+
+    LOGV("%s was called", __func__);
+
     err = load(GPS_HARDWARE_MODULE_ID, ORIGINAL_HAL_PATH, (hw_module_t const**)&module);
         
     if (err == 0) {
@@ -155,20 +522,29 @@ const GpsInterface* gps_get_gps_interface(struct gps_device_t* dev)
     {
         LOGV("%s exposing callbacks", __func__); 
         newGpsInterface.size = sizeof(GpsInterface);
-        newGpsInterface.init = originalGpsInterface->init;
-        newGpsInterface.start = originalGpsInterface->start;
-        newGpsInterface.stop = originalGpsInterface->stop;
-        newGpsInterface.cleanup = originalGpsInterface->cleanup;
+        newGpsInterface.init = wrapper_init;
+        newGpsInterface.start = wrapper_start;
+        newGpsInterface.stop = wrapper_stop;
+        newGpsInterface.cleanup = wrapper_cleanup;
         newGpsInterface.inject_time = originalGpsInterface->inject_time;
         newGpsInterface.inject_location = originalGpsInterface->inject_location;
         newGpsInterface.delete_aiding_data = originalGpsInterface->delete_aiding_data;
-        newGpsInterface.set_position_mode = originalGpsInterface->set_position_mode;
+        newGpsInterface.set_position_mode = wrapper_set_position_mode;
         LOGV("%s setting extension wrapper", __func__);
         newGpsInterface.get_extension = wrapper_get_extension;
-
+    } else {
+        LOGE("%s: no vendor GPS interface, GPS is unavailable", __func__);
     }
-    LOGV("%s done", __func__);
-    return &newGpsInterface;
+}
+
+const GpsInterface* gps_get_gps_interface(struct gps_device_t* dev)
+{
+	LOGV("%s was called", __func__);    
+
+    pthread_once(&vendorOnce, load_vendor);
+
+    /* without a vendor interface there is nothing to wrap */
+    return originalGpsInterface ? &newGpsInterface : NULL;
 }
 
 static int open_gps(const struct hw_module_t* module, char const* name,
@@ -184,6 +560,9 @@ static int open_gps(const struct hw_module_t* module, char const* name,
     dev->common.module = (struct hw_module_t*)module;
     dev->get_gps_interface = gps_get_gps_interface;
 
+    /* preload with the first open, i.e. while system_server boots */
+    pthread_once(&vendorOnce, load_vendor);
+
     *device = (struct hw_device_t*)dev;
     return 0;
 }
@@ -0,0 +1,158 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * location batching
+ *
+ * Holds fixes in a ring buffer and hands them to the framework in
+ * batches, so system_server is woken once per batch instead of once per
+ * fix during long tracking sessions. Fixes keep their own timestamps and
+ * are delivered in order.
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_TAG "gps-wrapper"
+#include <utils/Log.h>
+
+#include "gps_batch.h"
+
+#define EARTH_RADIUS_M 6371000.0
+#define DEG_TO_RAD (M_PI / 180.0)
+
+static pthread_mutex_t batchLock = PTHREAD_MUTEX_INITIALIZER;
+static gps_location_callback batchDeliver = NULL;
+static uint32_t batchIntervalMs = 0;
+static uint32_t batchDistanceM = 0;
+
+static GpsLocation batchFixes[GPS_BATCH_MAX_FIXES];
+static int batchHead = 0;
+static int batchCount = 0;
+/* monotonic time the oldest buffered fix arrived */
+static int64_t batchStartMs = 0;
+
+static GpsLocation lastDelivered;
+static int haveLastDelivered = 0;
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* equirectangular approximation, plenty for thresholds of a few meters up */
+static double distance_m(const GpsLocation *a, const GpsLocation *b)
+{
+    double x = (b->longitude - a->longitude) * DEG_TO_RAD *
+            cos((a->latitude + b->latitude) * 0.5 * DEG_TO_RAD);
+    double y = (b->latitude - a->latitude) * DEG_TO_RAD;
+
+    return sqrt(x * x + y * y) * EARTH_RADIUS_M;
+}
+
+/* called with batchLock held, the framework sees the fixes in order */
+static void flush_locked(void)
+{
+    if (batchCount)
+        LOGV("%s: delivering %d fixes", __func__, batchCount);
+
+    while (batchCount) {
+        GpsLocation *fix = &batchFixes[batchHead];
+
+        batchHead = (batchHead + 1) % GPS_BATCH_MAX_FIXES;
+        batchCount--;
+        if (batchDeliver)
+            batchDeliver(fix);
+        /* distances are measured from the last position delivered */
+        if (fix->flags & GPS_LOCATION_HAS_LAT_LONG) {
+            lastDelivered = *fix;
+            haveLastDelivered = 1;
+        }
+    }
+}
+
+void gps_batch_configure(gps_location_callback deliver,
+        uint32_t interval_ms, uint32_t distance_m)
+{
+    pthread_mutex_lock(&batchLock);
+    flush_locked();
+    batchDeliver = deliver;
+    batchIntervalMs = interval_ms;
+    batchDistanceM = distance_m;
+    haveLastDelivered = 0;
+    pthread_mutex_unlock(&batchLock);
+
+    if (interval_ms || distance_m)
+        LOGI("%s: batching fixes, interval %ums, distance %um", __func__,
+                interval_ms, distance_m);
+}
+
+void gps_batch_start(void)
+{
+    pthread_mutex_lock(&batchLock);
+    flush_locked();
+    haveLastDelivered = 0;
+    batchStartMs = 0;
+    pthread_mutex_unlock(&batchLock);
+}
+
+void gps_batch_location(GpsLocation *location)
+{
+    int64_t now;
+    int due;
+
+    pthread_mutex_lock(&batchLock);
+
+    if (!batchIntervalMs && !batchDistanceM) {
+        if (batchDeliver)
+            batchDeliver(location);
+        pthread_mutex_unlock(&batchLock);
+        return;
+    }
+
+    now = now_ms();
+    if (!batchCount)
+        batchStartMs = now;
+
+    batchFixes[(batchHead + batchCount) % GPS_BATCH_MAX_FIXES] = *location;
+    batchCount++;
+
+    /* the session's first fix is never held back */
+    due = !haveLastDelivered || batchCount == GPS_BATCH_MAX_FIXES;
+    if (batchIntervalMs && now - batchStartMs >= batchIntervalMs)
+        due = 1;
+    /* fixes without a position cannot move anything */
+    if (batchDistanceM && (location->flags & GPS_LOCATION_HAS_LAT_LONG) &&
+            haveLastDelivered && distance_m(&lastDelivered, location) >= batchDistanceM)
+        due = 1;
+
+    if (due)
+        flush_locked();
+
+    pthread_mutex_unlock(&batchLock);
+}
+
+void gps_batch_flush(void)
+{
+    pthread_mutex_lock(&batchLock);
+    flush_locked();
+    pthread_mutex_unlock(&batchLock);
+}
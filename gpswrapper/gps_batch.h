@@ -0,0 +1,51 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * location batching
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef GPS_BATCH_H
+#define GPS_BATCH_H
+
+#include <hardware/gps.h>
+
+/* fixes held at most, a full buffer is flushed at once */
+#define GPS_BATCH_MAX_FIXES 64
+
+/**
+ * Sets where batches are delivered and when. A batch is flushed once its
+ * oldest fix is interval_ms old, or once the newest fix is distance_m
+ * away from the last fix delivered. Both 0 turns batching off and every
+ * fix is delivered at once.
+ */
+void gps_batch_configure(gps_location_callback deliver,
+        uint32_t interval_ms, uint32_t distance_m);
+
+/**
+ * Starts a navigation session: the first fix after this is delivered at
+ * once, whatever the batching mode, so the framework gets its first fix
+ * without waiting for a batch.
+ */
+void gps_batch_start(void);
+
+/** Buffers a fix, delivering the batch if it is due. */
+void gps_batch_location(GpsLocation *location);
+
+/** Delivers the buffered fixes now, e.g. when navigation stops. */
+void gps_batch_flush(void);
+
+#endif /* GPS_BATCH_H */
@@ -0,0 +1,533 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * callback dispatch thread
+ *
+ * The vendor library calls its callbacks on its own thread and waits for
+ * them, so a framework callback that takes long stalls the receiver.
+ * Callbacks are instead copied into per kind ring buffers and delivered
+ * by a thread of the wrapper. Every entry is stamped with a sequence
+ * number shared by all rings, and the thread always delivers the oldest
+ * head of the rings, so the framework sees callbacks in the order the
+ * vendor made them, e.g. no fix after the session end status.
+ *
+ * Producers of a ring are serialized by the ring's lock: status comes
+ * from the vendor's own thread as well as from the thread calling its
+ * start and stop. The dispatch thread is the only consumer and never
+ * takes that lock. When a ring is full its policy decides: locations and
+ * status make the vendor wait, satellite status and NMEA drop their
+ * oldest entry by default. The producer drops an entry by moving the
+ * consumer's index, the consumer then notices its copy went stale when
+ * its own move fails.
+ *
+ * The framework's wakelock is held from the first queued entry until the
+ * thread has delivered everything, so the device does not suspend with
+ * a session end or a fix still queued.
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_TAG "gps-wrapper"
+#include <utils/Log.h>
+#include <cutils/atomic.h>
+
+#include "gps_dispatch.h"
+
+/* how long a blocked producer sleeps before looking again */
+#define BLOCK_WAIT_MS 20
+
+#define STATUS_SLOTS 8
+
+typedef struct {
+    GpsUtcTime timestamp;
+    int length;
+    char data[GPS_DISPATCH_NMEA_MAX];
+} nmea_entry_t;
+
+typedef struct {
+    const char *name;
+    gps_dispatch_policy_t policy;
+    uint32_t slots;
+    size_t slot_size;
+    char *data;
+    /* the sequence number of each slot's entry */
+    volatile int32_t *seq;
+    /* free running, written by the producer */
+    volatile int32_t head;
+    /* free running, written by the consumer and by a producer dropping */
+    volatile int32_t tail;
+    /* a blocked producer waits for the consumer */
+    volatile int32_t waiting;
+    /* serializes producers, and queueing against gps_dispatch_stop */
+    pthread_mutex_t lock;
+    /* producer side counters */
+    uint32_t queued;
+    uint32_t dropped;
+    uint32_t blocked;
+    uint32_t high_water;
+    /* consumer side */
+    uint32_t delivered;
+} ring_t;
+
+static ring_t statusRing = { "status", GPS_DISPATCH_BLOCK, STATUS_SLOTS,
+        sizeof(GpsStatus), NULL, NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+static ring_t fixRing = { "location", GPS_DISPATCH_BLOCK, GPS_DISPATCH_FIX_SLOTS,
+        sizeof(GpsLocation), NULL, NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+static ring_t svRing = { "sv_status", GPS_DISPATCH_DROP_OLDEST, GPS_DISPATCH_SV_SLOTS,
+        sizeof(GpsSvStatus), NULL, NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+static ring_t nmeaRing = { "nmea", GPS_DISPATCH_DROP_OLDEST, GPS_DISPATCH_NMEA_SLOTS,
+        sizeof(nmea_entry_t), NULL, NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static ring_t *rings[] = { &statusRing, &fixRing, &svRing, &nmeaRing };
+#define NUM_RINGS (int)(sizeof(rings) / sizeof(rings[0]))
+
+static gps_dispatch_callbacks_t dispatchCallbacks;
+
+/* the next entry's sequence number, across all rings */
+static volatile int32_t nextSeq = 0;
+
+static pthread_mutex_t dispatchLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t roomCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t exitCond = PTHREAD_COND_INITIALIZER;
+/* callbacks go through the rings while set */
+static volatile int32_t active = 0;
+static volatile int32_t consumerSleeping = 0;
+/* the framework's wakelock is held for queued entries */
+static pthread_mutex_t wakelockLock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int32_t wakelockHeld = 0;
+static int exiting = 0;
+static int threadRunning = 0;
+
+/* a slot large enough for any ring, the consumer copies into it */
+static union {
+    GpsLocation location;
+    GpsStatus status;
+    GpsSvStatus sv_status;
+    nmea_entry_t nmea;
+} consumerSlot;
+
+static void *slot(ring_t *ring, int32_t index)
+{
+    return ring->data + ((uint32_t)index % ring->slots) * ring->slot_size;
+}
+
+static int ring_empty(ring_t *ring)
+{
+    return android_atomic_acquire_load(&ring->head) ==
+            android_atomic_acquire_load(&ring->tail);
+}
+
+static int all_empty(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_RINGS; i++) {
+        if (!ring_empty(rings[i]))
+            return 0;
+    }
+    return 1;
+}
+
+static void wait_for_room(ring_t *ring)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += BLOCK_WAIT_MS * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&dispatchLock);
+    android_atomic_release_store(1, &ring->waiting);
+    android_memory_barrier();
+    /* the timeout covers a wakeup lost between the check and the wait */
+    if ((uint32_t)(ring->head - android_atomic_acquire_load(&ring->tail)) >= ring->slots)
+        pthread_cond_timedwait(&roomCond, &dispatchLock, &deadline);
+    android_atomic_release_store(0, &ring->waiting);
+    pthread_mutex_unlock(&dispatchLock);
+}
+
+/* the framework's wakelock does not count, so calls go out in flag order */
+static void acquire_wakelock(void)
+{
+    if (android_atomic_acquire_load(&wakelockHeld))
+        return;
+
+    pthread_mutex_lock(&wakelockLock);
+    if (!wakelockHeld) {
+        android_atomic_release_store(1, &wakelockHeld);
+        if (dispatchCallbacks.acquire_wakelock_cb)
+            dispatchCallbacks.acquire_wakelock_cb();
+    }
+    pthread_mutex_unlock(&wakelockLock);
+}
+
+static void release_wakelock(void)
+{
+    pthread_mutex_lock(&wakelockLock);
+    if (wakelockHeld) {
+        android_atomic_release_store(0, &wakelockHeld);
+        if (dispatchCallbacks.release_wakelock_cb)
+            dispatchCallbacks.release_wakelock_cb();
+    }
+    pthread_mutex_unlock(&wakelockLock);
+}
+
+static void wake_consumer(void)
+{
+    android_memory_barrier();
+    if (android_atomic_acquire_load(&consumerSleeping)) {
+        pthread_mutex_lock(&dispatchLock);
+        pthread_cond_signal(&workCond);
+        pthread_mutex_unlock(&dispatchLock);
+    }
+}
+
+/*
+ * producer side, returns 0 if the entry was dropped and -1 if the thread
+ * is stopping, then the caller delivers itself
+ */
+static int ring_push(ring_t *ring, const void *entry, size_t size)
+{
+    int32_t head;
+    int32_t tail;
+    uint32_t depth;
+
+    pthread_mutex_lock(&ring->lock);
+    if (!android_atomic_acquire_load(&active)) {
+        pthread_mutex_unlock(&ring->lock);
+        return -1;
+    }
+
+    head = ring->head;
+    for (;;) {
+        tail = android_atomic_acquire_load(&ring->tail);
+        if ((uint32_t)(head - tail) < ring->slots)
+            break;
+
+        switch (ring->policy) {
+        case GPS_DISPATCH_BLOCK:
+            ring->blocked++;
+            wait_for_room(ring);
+            break;
+        case GPS_DISPATCH_DROP_NEWEST:
+            ring->dropped++;
+            pthread_mutex_unlock(&ring->lock);
+            return 0;
+        case GPS_DISPATCH_DROP_OLDEST:
+            /* fails if the consumer took it meanwhile, then there is room */
+            if (!android_atomic_release_cas(tail, tail + 1, &ring->tail))
+                ring->dropped++;
+            break;
+        }
+    }
+
+    memcpy(slot(ring, head), entry, size);
+    ring->seq[(uint32_t)head % ring->slots] = android_atomic_inc(&nextSeq);
+    android_atomic_release_store(head + 1, &ring->head);
+
+    ring->queued++;
+    depth = (uint32_t)(head + 1 - tail);
+    if (depth > ring->high_water)
+        ring->high_water = depth;
+    pthread_mutex_unlock(&ring->lock);
+
+    /* after head moved, the consumer releases before it looks again */
+    acquire_wakelock();
+    wake_consumer();
+    return 1;
+}
+
+/* consumer side, copies the oldest entry out, returns 0 when empty */
+static int ring_pop(ring_t *ring, void *entry)
+{
+    int32_t tail;
+
+    for (;;) {
+        tail = android_atomic_acquire_load(&ring->tail);
+        if (tail == android_atomic_acquire_load(&ring->head))
+            return 0;
+
+        memcpy(entry, slot(ring, tail), ring->slot_size);
+        /* a producer that dropped this entry moved tail first, the copy is stale */
+        if (!android_atomic_release_cas(tail, tail + 1, &ring->tail))
+            break;
+    }
+
+    ring->delivered++;
+    if (android_atomic_acquire_load(&ring->waiting)) {
+        pthread_mutex_lock(&dispatchLock);
+        pthread_cond_signal(&roomCond);
+        pthread_mutex_unlock(&dispatchLock);
+    }
+    return 1;
+}
+
+static void deliver(ring_t *ring)
+{
+    if (ring == &statusRing)
+        dispatchCallbacks.status_cb(&consumerSlot.status);
+    else if (ring == &fixRing)
+        dispatchCallbacks.location_cb(&consumerSlot.location);
+    else if (ring == &svRing)
+        dispatchCallbacks.sv_status_cb(&consumerSlot.sv_status);
+    else
+        dispatchCallbacks.nmea_cb(consumerSlot.nmea.timestamp, consumerSlot.nmea.data,
+                consumerSlot.nmea.length);
+}
+
+/*
+ * The ring whose oldest entry came first, NULL when all are empty. A
+ * producer dropping that entry meanwhile only makes the pick a little
+ * early, ring_pop still takes the ring's oldest.
+ */
+static ring_t *oldest_ring(void)
+{
+    ring_t *oldest = NULL;
+    int32_t oldestSeq = 0;
+    int i;
+
+    for (i = 0; i < NUM_RINGS; i++) {
+        ring_t *ring = rings[i];
+        int32_t tail = android_atomic_acquire_load(&ring->tail);
+        int32_t seq;
+
+        if (tail == android_atomic_acquire_load(&ring->head))
+            continue;
+        seq = ring->seq[(uint32_t)tail % ring->slots];
+        /* the difference keeps the order across the counter wrapping */
+        if (!oldest || (int32_t)((uint32_t)seq - (uint32_t)oldestSeq) < 0) {
+            oldest = ring;
+            oldestSeq = seq;
+        }
+    }
+    return oldest;
+}
+
+/* everything queued so far in arrival order, returns 0 if there was nothing */
+static int drain(void)
+{
+    int delivered = 0;
+    ring_t *ring;
+
+    while ((ring = oldest_ring()) != NULL) {
+        if (ring_pop(ring, &consumerSlot)) {
+            deliver(ring);
+            delivered = 1;
+        }
+    }
+    return delivered;
+}
+
+static void dispatch_thread(void *arg)
+{
+    LOGV("%s: started", __func__);
+
+    for (;;) {
+        if (drain())
+            continue;
+
+        release_wakelock();
+        android_memory_barrier();
+        /* an entry queued while the wakelock was going keeps it */
+        if (!all_empty()) {
+            acquire_wakelock();
+            continue;
+        }
+
+        android_atomic_release_store(1, &consumerSleeping);
+        android_memory_barrier();
+
+        pthread_mutex_lock(&dispatchLock);
+        while (!exiting && all_empty())
+            pthread_cond_wait(&workCond, &dispatchLock);
+        android_atomic_release_store(0, &consumerSleeping);
+        if (exiting && all_empty())
+            break;
+        pthread_mutex_unlock(&dispatchLock);
+    }
+
+    threadRunning = 0;
+    pthread_cond_broadcast(&exitCond);
+    pthread_mutex_unlock(&dispatchLock);
+    LOGV("%s: done", __func__);
+}
+
+gps_dispatch_policy_t gps_dispatch_parse_policy(const char *policy,
+        gps_dispatch_policy_t fallback)
+{
+    if (!strcmp(policy, "drop_oldest"))
+        return GPS_DISPATCH_DROP_OLDEST;
+    if (!strcmp(policy, "drop_newest"))
+        return GPS_DISPATCH_DROP_NEWEST;
+    return fallback;
+}
+
+static int ring_alloc(ring_t *ring)
+{
+    if (!ring->data)
+        ring->data = malloc(ring->slots * ring->slot_size);
+    if (!ring->seq)
+        ring->seq = malloc(ring->slots * sizeof(*ring->seq));
+    ring->head = ring->tail = 0;
+    ring->waiting = 0;
+    ring->queued = ring->dropped = ring->blocked = ring->high_water = 0;
+    ring->delivered = 0;
+    return ring->data && ring->seq ? 0 : -ENOMEM;
+}
+
+void gps_dispatch_start(const gps_dispatch_callbacks_t *callbacks,
+        gps_create_thread create_thread, int enable,
+        gps_dispatch_policy_t sv_policy, gps_dispatch_policy_t nmea_policy)
+{
+    int i;
+
+    gps_dispatch_stop();
+
+    dispatchCallbacks = *callbacks;
+    svRing.policy = sv_policy;
+    nmeaRing.policy = nmea_policy;
+
+    if (!enable || !create_thread)
+        return;
+
+    for (i = 0; i < NUM_RINGS; i++) {
+        if (ring_alloc(rings[i])) {
+            LOGE("%s: no memory for the %s queue", __func__, rings[i]->name);
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&dispatchLock);
+    exiting = 0;
+    threadRunning = 1;
+    pthread_mutex_unlock(&dispatchLock);
+
+    if (!create_thread("gps-wrapper-dispatch", dispatch_thread, NULL)) {
+        LOGE("%s: cannot create the dispatch thread", __func__);
+        threadRunning = 0;
+        return;
+    }
+    android_atomic_release_store(1, &active);
+}
+
+void gps_dispatch_stop(void)
+{
+    int i;
+
+    if (!android_atomic_acquire_load(&active))
+        return;
+
+    /* whatever got in before goes out through the thread, nothing after */
+    for (i = 0; i < NUM_RINGS; i++)
+        pthread_mutex_lock(&rings[i]->lock);
+    android_atomic_release_store(0, &active);
+    for (i = NUM_RINGS - 1; i >= 0; i--)
+        pthread_mutex_unlock(&rings[i]->lock);
+
+    pthread_mutex_lock(&dispatchLock);
+    exiting = 1;
+    pthread_cond_signal(&workCond);
+    while (threadRunning)
+        pthread_cond_wait(&exitCond, &dispatchLock);
+    pthread_mutex_unlock(&dispatchLock);
+}
+
+void gps_dispatch_location(GpsLocation *location)
+{
+    if (!android_atomic_acquire_load(&active) ||
+            ring_push(&fixRing, location, sizeof(*location)) < 0)
+        dispatchCallbacks.location_cb(location);
+}
+
+void gps_dispatch_status(GpsStatus *status)
+{
+    if (!android_atomic_acquire_load(&active) ||
+            ring_push(&statusRing, status, sizeof(*status)) < 0)
+        dispatchCallbacks.status_cb(status);
+}
+
+void gps_dispatch_sv_status(GpsSvStatus *sv_status)
+{
+    if (!android_atomic_acquire_load(&active) ||
+            ring_push(&svRing, sv_status, sizeof(*sv_status)) < 0)
+        dispatchCallbacks.sv_status_cb(sv_status);
+}
+
+void gps_dispatch_nmea(GpsUtcTime timestamp, const char *nmea, int length)
+{
+    nmea_entry_t entry;
+
+    if (!android_atomic_acquire_load(&active)) {
+        dispatchCallbacks.nmea_cb(timestamp, nmea, length);
+        return;
+    }
+
+    if (length > GPS_DISPATCH_NMEA_MAX - 1)
+        length = GPS_DISPATCH_NMEA_MAX - 1;
+    entry.timestamp = timestamp;
+    entry.length = length;
+    memcpy(entry.data, nmea, length);
+    entry.data[length] = 0;
+    if (ring_push(&nmeaRing, &entry, offsetof(nmea_entry_t, data) + length + 1) < 0)
+        dispatchCallbacks.nmea_cb(timestamp, nmea, length);
+}
+
+size_t gps_dispatch_dump(char *buffer, size_t size)
+{
+    size_t len = 0;
+    int i, n;
+
+    if (!size)
+        return 0;
+
+    n = snprintf(buffer, size, "wrapper.dispatch.active=%d\n",
+            android_atomic_acquire_load(&active));
+    len = n < 0 ? 0 : ((size_t)n < size ? (size_t)n : size - 1);
+
+    /* counters are read without the rings' cooperation, they may be a bit off */
+    for (i = 0; i < NUM_RINGS && len < size - 1; i++) {
+        ring_t *ring = rings[i];
+
+        n = snprintf(buffer + len, size - len,
+                "wrapper.dispatch.%s.depth=%u\n"
+                "wrapper.dispatch.%s.high_water=%u\n"
+                "wrapper.dispatch.%s.queued=%u\n"
+                "wrapper.dispatch.%s.delivered=%u\n"
+                "wrapper.dispatch.%s.dropped=%u\n"
+                "wrapper.dispatch.%s.blocked=%u\n",
+                ring->name, (uint32_t)(ring->head - ring->tail),
+                ring->name, ring->high_water,
+                ring->name, ring->queued,
+                ring->name, ring->delivered,
+                ring->name, ring->dropped,
+                ring->name, ring->blocked);
+        if (n < 0)
+            break;
+        len = len + n < size ? len + n : size - 1;
+    }
+    return len;
+}
@@ -0,0 +1,85 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * callback dispatch thread
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef GPS_DISPATCH_H
+#define GPS_DISPATCH_H
+
+#include <hardware/gps.h>
+
+typedef enum {
+    /* the vendor waits for room, nothing is lost */
+    GPS_DISPATCH_BLOCK,
+    /* the oldest queued entry makes room */
+    GPS_DISPATCH_DROP_OLDEST,
+    /* the new entry is dropped */
+    GPS_DISPATCH_DROP_NEWEST
+} gps_dispatch_policy_t;
+
+/* locations and status, never dropped */
+#define GPS_DISPATCH_FIX_SLOTS 32
+#define GPS_DISPATCH_SV_SLOTS 8
+#define GPS_DISPATCH_NMEA_SLOTS 32
+/* one sentence per slot, NMEA allows 82 bytes but vendors' own run longer */
+#define GPS_DISPATCH_NMEA_MAX 256
+
+/* where queued callbacks end up, called on the dispatch thread */
+typedef struct {
+    gps_location_callback location_cb;
+    gps_status_callback status_cb;
+    gps_sv_status_callback sv_status_cb;
+    gps_nmea_callback nmea_cb;
+    /* held while entries are queued, may be NULL */
+    gps_acquire_wakelock acquire_wakelock_cb;
+    gps_release_wakelock release_wakelock_cb;
+} gps_dispatch_callbacks_t;
+
+/** Parses "drop_oldest" or "drop_newest", anything else gives fallback. */
+gps_dispatch_policy_t gps_dispatch_parse_policy(const char *policy,
+        gps_dispatch_policy_t fallback);
+
+/**
+ * Starts the dispatch thread through create_thread, as the framework
+ * only takes callbacks on threads it created. With enable 0, or if the
+ * thread cannot be created, callbacks are delivered on the caller's
+ * thread as before.
+ */
+void gps_dispatch_start(const gps_dispatch_callbacks_t *callbacks,
+        gps_create_thread create_thread, int enable,
+        gps_dispatch_policy_t sv_policy, gps_dispatch_policy_t nmea_policy);
+
+/** Delivers what is queued and ends the dispatch thread. */
+void gps_dispatch_stop(void);
+
+/*
+ * Queue a callback for the dispatch thread, from any thread; the data is
+ * copied. Once gps_dispatch_stop began they are delivered right away.
+ */
+void gps_dispatch_location(GpsLocation *location);
+void gps_dispatch_status(GpsStatus *status);
+void gps_dispatch_sv_status(GpsSvStatus *sv_status);
+void gps_dispatch_nmea(GpsUtcTime timestamp, const char *nmea, int length);
+
+/**
+ * Writes queue depths and drop counters as text for GpsDebugInterface.
+ * @return the number of bytes written, without a terminating 0.
+ */
+size_t gps_dispatch_dump(char *buffer, size_t size);
+
+#endif /* GPS_DISPATCH_H */
@@ -0,0 +1,303 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * fix interval governor
+ *
+ * The vendor library computes fixes at whatever interval the framework
+ * asked for, also while the phone sits on a desk. The governor watches
+ * the reported speed and how far the fixes wander, and once the device
+ * is stationary it asks the vendor for fixes less often. The first fix
+ * that moves brings back the requested interval.
+ *
+ * New intervals are applied from a thread of our own, the vendor is never
+ * called back from inside its location callback.
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_TAG "gps-wrapper"
+#include <utils/Log.h>
+
+#include "gps_governor.h"
+
+#define EARTH_RADIUS_M 6371000.0
+#define DEG_TO_RAD (M_PI / 180.0)
+
+typedef struct {
+    GpsPositionMode mode;
+    GpsPositionRecurrence recurrence;
+    uint32_t min_interval;
+    uint32_t preferred_accuracy;
+    uint32_t preferred_time;
+} position_mode_t;
+
+static pthread_mutex_t governorLock = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Held around every vendor set_position_mode, taken before governorLock,
+ * so the framework's call and the thread's cannot overtake each other.
+ */
+static pthread_mutex_t vendorLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t governorCond = PTHREAD_COND_INITIALIZER;
+static pthread_t governorThread;
+static int threadStarted = 0;
+
+static const GpsInterface *vendorGps = NULL;
+static uint32_t stationaryIntervalMs = 0;
+static uint32_t speedCms = 0;
+static uint32_t distanceM = 0;
+static uint32_t stationaryFixes = 0;
+
+static position_mode_t requested;
+static int haveRequested = 0;
+static uint32_t appliedInterval = 0;
+/* interval the thread still has to apply, 0 for none */
+static uint32_t pendingInterval = 0;
+
+static int navigating = 0;
+static int stationary = 0;
+static uint32_t stillFixes = 0;
+static double anchorLatitude;
+static double anchorLongitude;
+static int haveAnchor = 0;
+
+static uint32_t switches = 0;
+static int64_t stationarySinceMs = 0;
+static int64_t stationaryTotalMs = 0;
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* equirectangular approximation, plenty for thresholds of a few meters up */
+static double distance_m(double lat1, double lon1, double lat2, double lon2)
+{
+    double x = (lon2 - lon1) * DEG_TO_RAD * cos((lat1 + lat2) * 0.5 * DEG_TO_RAD);
+    double y = (lat2 - lat1) * DEG_TO_RAD;
+
+    return sqrt(x * x + y * y) * EARTH_RADIUS_M;
+}
+
+/* called with governorLock held */
+static uint32_t effective_interval_locked(void)
+{
+    if (stationary && requested.min_interval < stationaryIntervalMs)
+        return stationaryIntervalMs;
+    return requested.min_interval;
+}
+
+static void *governor_thread(void *arg)
+{
+    position_mode_t mode;
+    uint32_t interval;
+
+    for (;;) {
+        pthread_mutex_lock(&governorLock);
+        while (!pendingInterval)
+            pthread_cond_wait(&governorCond, &governorLock);
+        pthread_mutex_unlock(&governorLock);
+
+        /* the framework may have set a mode meanwhile, which clears pending */
+        pthread_mutex_lock(&vendorLock);
+        pthread_mutex_lock(&governorLock);
+        interval = pendingInterval;
+        pendingInterval = 0;
+        mode = requested;
+        if (interval)
+            appliedInterval = interval;
+        pthread_mutex_unlock(&governorLock);
+
+        if (interval) {
+            LOGV("%s: fix interval %ums", __func__, interval);
+            vendorGps->set_position_mode(mode.mode, mode.recurrence, interval,
+                    mode.preferred_accuracy, mode.preferred_time);
+        }
+        pthread_mutex_unlock(&vendorLock);
+    }
+    return NULL;
+}
+
+/* called with governorLock held, hands a new interval to the thread */
+static void apply_locked(uint32_t interval)
+{
+    if (!threadStarted) {
+        if (pthread_create(&governorThread, NULL, governor_thread, NULL)) {
+            LOGE("%s: cannot start the governor thread", __func__);
+            return;
+        }
+        threadStarted = 1;
+    }
+    pendingInterval = interval;
+    switches++;
+    pthread_cond_signal(&governorCond);
+}
+
+void gps_governor_configure(const GpsInterface *gps, uint32_t stationary_interval_ms,
+        uint32_t speed_cms, uint32_t distance_m, uint32_t stationary_fixes)
+{
+    pthread_mutex_lock(&governorLock);
+    vendorGps = gps;
+    stationaryIntervalMs = stationary_interval_ms;
+    speedCms = speed_cms;
+    distanceM = distance_m;
+    stationaryFixes = stationary_fixes ? stationary_fixes : 1;
+    pthread_mutex_unlock(&governorLock);
+
+    if (stationary_interval_ms)
+        LOGI("%s: %ums between fixes after %u fixes under %ucm/s within %um",
+                __func__, stationary_interval_ms, stationary_fixes, speed_cms, distance_m);
+}
+
+int gps_governor_set_position_mode(GpsPositionMode mode, GpsPositionRecurrence recurrence,
+        uint32_t min_interval, uint32_t preferred_accuracy, uint32_t preferred_time)
+{
+    uint32_t interval;
+    int ret;
+
+    pthread_mutex_lock(&vendorLock);
+    pthread_mutex_lock(&governorLock);
+    requested.mode = mode;
+    requested.recurrence = recurrence;
+    requested.min_interval = min_interval;
+    requested.preferred_accuracy = preferred_accuracy;
+    requested.preferred_time = preferred_time;
+    haveRequested = 1;
+    interval = effective_interval_locked();
+    appliedInterval = interval;
+    /* the framework's own call wins over one still queued */
+    pendingInterval = 0;
+    pthread_mutex_unlock(&governorLock);
+
+    ret = vendorGps->set_position_mode(mode, recurrence, interval,
+            preferred_accuracy, preferred_time);
+    pthread_mutex_unlock(&vendorLock);
+    return ret;
+}
+
+void gps_governor_location(const GpsLocation *location)
+{
+    int moving;
+
+    if (!(location->flags & GPS_LOCATION_HAS_LAT_LONG))
+        return;
+
+    pthread_mutex_lock(&governorLock);
+
+    if (!stationaryIntervalMs || !navigating || !haveRequested ||
+            requested.recurrence != GPS_POSITION_RECURRENCE_PERIODIC) {
+        pthread_mutex_unlock(&governorLock);
+        return;
+    }
+
+    moving = (location->flags & GPS_LOCATION_HAS_SPEED) && location->speed * 100 >= speedCms;
+    if (haveAnchor && distance_m(anchorLatitude, anchorLongitude,
+            location->latitude, location->longitude) >= distanceM)
+        moving = 1;
+
+    if (moving || !haveAnchor) {
+        anchorLatitude = location->latitude;
+        anchorLongitude = location->longitude;
+        haveAnchor = 1;
+    }
+
+    if (moving) {
+        stillFixes = 0;
+        if (stationary) {
+            LOGV("%s: moving again", __func__);
+            stationary = 0;
+            stationaryTotalMs += now_ms() - stationarySinceMs;
+            apply_locked(effective_interval_locked());
+        }
+    } else if (!stationary && ++stillFixes >= stationaryFixes) {
+        LOGV("%s: stationary", __func__);
+        stationary = 1;
+        stationarySinceMs = now_ms();
+        if (effective_interval_locked() != appliedInterval)
+            apply_locked(effective_interval_locked());
+    }
+
+    pthread_mutex_unlock(&governorLock);
+}
+
+void gps_governor_start(void)
+{
+    position_mode_t mode;
+    int restore;
+
+    pthread_mutex_lock(&vendorLock);
+    pthread_mutex_lock(&governorLock);
+    navigating = 1;
+    stationary = 0;
+    stillFixes = 0;
+    haveAnchor = 0;
+    pendingInterval = 0;
+    /* a session that ended stationary must not slow down the next one */
+    restore = haveRequested && appliedInterval != requested.min_interval;
+    mode = requested;
+    if (restore)
+        appliedInterval = requested.min_interval;
+    pthread_mutex_unlock(&governorLock);
+
+    if (restore)
+        vendorGps->set_position_mode(mode.mode, mode.recurrence, mode.min_interval,
+                mode.preferred_accuracy, mode.preferred_time);
+    pthread_mutex_unlock(&vendorLock);
+}
+
+void gps_governor_stop(void)
+{
+    pthread_mutex_lock(&governorLock);
+    navigating = 0;
+    pendingInterval = 0;
+    /* time between sessions is not stationary time */
+    if (stationary)
+        stationaryTotalMs += now_ms() - stationarySinceMs;
+    stationary = 0;
+    pthread_mutex_unlock(&governorLock);
+}
+
+size_t gps_governor_dump(char *buffer, size_t size)
+{
+    int64_t stationary_ms;
+    int n;
+
+    if (!size)
+        return 0;
+
+    pthread_mutex_lock(&governorLock);
+    stationary_ms = stationaryTotalMs + (stationary ? now_ms() - stationarySinceMs : 0);
+    n = snprintf(buffer, size,
+            "wrapper.governor.requested_ms=%u\n"
+            "wrapper.governor.applied_ms=%u\n"
+            "wrapper.governor.stationary=%d\n"
+            "wrapper.governor.stationary_ms=%lld\n"
+            "wrapper.governor.switches=%u\n",
+            haveRequested ? requested.min_interval : 0, appliedInterval,
+            stationary, (long long)stationary_ms, switches);
+    pthread_mutex_unlock(&governorLock);
+
+    if (n < 0)
+        return 0;
+    return (size_t)n < size ? (size_t)n : size - 1;
+}
@@ -0,0 +1,53 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * fix interval governor
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef GPS_GOVERNOR_H
+#define GPS_GOVERNOR_H
+
+#include <hardware/gps.h>
+
+/**
+ * Sets the vendor interface position modes are applied to and when the
+ * device counts as stationary: stationary_fixes fixes in a row slower
+ * than speed_cms and within distance_m of where they started. While
+ * stationary the fix interval is raised to stationary_interval_ms, 0
+ * turns the governor off.
+ */
+void gps_governor_configure(const GpsInterface *gps, uint32_t stationary_interval_ms,
+        uint32_t speed_cms, uint32_t distance_m, uint32_t stationary_fixes);
+
+/** The framework's set_position_mode, applied now and remembered. */
+int gps_governor_set_position_mode(GpsPositionMode mode, GpsPositionRecurrence recurrence,
+        uint32_t min_interval, uint32_t preferred_accuracy, uint32_t preferred_time);
+
+/** A fix from the vendor. */
+void gps_governor_location(const GpsLocation *location);
+
+/** Navigation started or stopped, a new session starts at the requested rate. */
+void gps_governor_start(void);
+void gps_governor_stop(void);
+
+/**
+ * Writes the governor state as text for GpsDebugInterface.
+ * @return the number of bytes written, without a terminating 0.
+ */
+size_t gps_governor_dump(char *buffer, size_t size);
+
+#endif /* GPS_GOVERNOR_H */
@@ -0,0 +1,303 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * NMEA coalescing
+ *
+ * The vendor library reports every NMEA sentence with its own callback,
+ * each one a JNI call into system_server whether or not anybody listens.
+ * Here sentences that did not change since they were last forwarded,
+ * typically GSA, VTG and GSV pages while the sky stays the same, are
+ * dropped. Whole fix epochs can also be forwarded no more often than a
+ * minimum interval, or nothing at all. Forwarded sentences still go out
+ * one per callback as they arrive, so listeners see neither joined
+ * sentences nor a delay.
+ *
+ * An epoch ends when a sentence type seen in it comes around again. GSV
+ * sentences are paged within an epoch and never end one.
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_TAG "gps-wrapper"
+#include <utils/Log.h>
+
+#include "gps_nmea.h"
+
+/* "GPGGA", "GPGSV", ... */
+#define NMEA_TYPE_MAX 8
+#define EPOCH_TYPES_MAX 16
+
+/* "$GPGGA," or for GSV pages "$GPGSV,3,1," */
+#define REPEAT_KEY_MAX 16
+/* last forwarded sentences kept to spot repeats, longer ones always go out */
+#define REPEAT_SLOTS 16
+#define REPEAT_SENTENCE_MAX 96
+
+typedef struct {
+    char key[REPEAT_KEY_MAX];
+    int key_length;
+    int length;
+    char data[REPEAT_SENTENCE_MAX];
+    int64_t forwarded_ms;
+} repeat_slot_t;
+
+static pthread_mutex_t nmeaLock = PTHREAD_MUTEX_INITIALIZER;
+static gps_nmea_callback nmeaDeliver = NULL;
+static gps_nmea_mode_t nmeaMode = GPS_NMEA_MODE_PASS;
+static uint32_t nmeaMinIntervalMs = 0;
+
+/* sentence types of the current epoch */
+static char epochTypes[EPOCH_TYPES_MAX][NMEA_TYPE_MAX];
+static int epochNumTypes = 0;
+/* the epoch began too soon after the last one and is dropped */
+static int epochSkipped = 0;
+static int64_t lastEpochMs = 0;
+
+static repeat_slot_t repeatSlots[REPEAT_SLOTS];
+static int numRepeatSlots = 0;
+static int nextRepeatSlot = 0;
+
+static uint32_t sentenceCount = 0;
+static uint32_t epochCount = 0;
+static uint32_t callbackCount = 0;
+static uint32_t droppedSentences = 0;
+static uint32_t droppedEpochs = 0;
+static uint32_t droppedRepeats = 0;
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+gps_nmea_mode_t gps_nmea_parse_mode(const char *mode)
+{
+    if (!strcmp(mode, "pass"))
+        return GPS_NMEA_MODE_PASS;
+    if (!strcmp(mode, "off"))
+        return GPS_NMEA_MODE_OFF;
+    return GPS_NMEA_MODE_EPOCH;
+}
+
+/* the address field, "$GPGGA,..." gives "GPGGA" */
+static void sentence_type(const char *nmea, int length, char *type)
+{
+    int i = 0;
+
+    if (length && *nmea == '$') {
+        nmea++;
+        length--;
+    }
+    while (i < length && i < NMEA_TYPE_MAX - 1 && nmea[i] != ',' && nmea[i] != '*') {
+        type[i] = nmea[i];
+        i++;
+    }
+    type[i] = 0;
+}
+
+static int is_gsv(const char *type)
+{
+    size_t len = strlen(type);
+
+    return len >= 3 && !strcmp(type + len - 3, "GSV");
+}
+
+/* up to the first comma, for GSV up to the third so every page is its own */
+static int repeat_key_length(const char *nmea, int length, int gsv)
+{
+    int commas = gsv ? 3 : 1;
+    int i;
+
+    for (i = 0; i < length && i < REPEAT_KEY_MAX; i++) {
+        if (nmea[i] == ',' && !--commas)
+            return i + 1;
+    }
+    return -1;
+}
+
+/* called with nmeaLock held, returns 1 when the sentence is an unchanged repeat */
+static int repeat_locked(const char *nmea, int length, int gsv)
+{
+    int keyLength = repeat_key_length(nmea, length, gsv);
+    int64_t now = now_ms();
+    repeat_slot_t *slot = NULL;
+    int i;
+
+    if (keyLength < 0 || length > REPEAT_SENTENCE_MAX)
+        return 0;
+
+    for (i = 0; i < numRepeatSlots; i++) {
+        if (repeatSlots[i].key_length == keyLength &&
+                !memcmp(repeatSlots[i].key, nmea, keyLength)) {
+            slot = &repeatSlots[i];
+            break;
+        }
+    }
+
+    if (slot && slot->length == length && !memcmp(slot->data, nmea, length) &&
+            now - slot->forwarded_ms < GPS_NMEA_REPEAT_REFRESH_MS)
+        return 1;
+
+    if (!slot) {
+        if (numRepeatSlots < REPEAT_SLOTS) {
+            slot = &repeatSlots[numRepeatSlots++];
+        } else {
+            slot = &repeatSlots[nextRepeatSlot];
+            nextRepeatSlot = (nextRepeatSlot + 1) % REPEAT_SLOTS;
+        }
+        memcpy(slot->key, nmea, keyLength);
+        slot->key_length = keyLength;
+    }
+    memcpy(slot->data, nmea, length);
+    slot->length = length;
+    slot->forwarded_ms = now;
+    return 0;
+}
+
+static void end_epoch_locked(void)
+{
+    epochNumTypes = 0;
+    epochSkipped = 0;
+}
+
+static void begin_epoch_locked(void)
+{
+    int64_t now = now_ms();
+
+    epochCount++;
+    if (nmeaMinIntervalMs && lastEpochMs && now - lastEpochMs < nmeaMinIntervalMs) {
+        epochSkipped = 1;
+        droppedEpochs++;
+        return;
+    }
+    lastEpochMs = now;
+}
+
+static void epoch_sentence_locked(GpsUtcTime timestamp, const char *nmea, int length)
+{
+    char type[NMEA_TYPE_MAX];
+    int seen = 0;
+    int i;
+
+    sentence_type(nmea, length, type);
+    for (i = 0; i < epochNumTypes; i++) {
+        if (!strcmp(epochTypes[i], type)) {
+            seen = 1;
+            break;
+        }
+    }
+
+    if (!epochNumTypes || (seen && !is_gsv(type))) {
+        if (epochNumTypes)
+            end_epoch_locked();
+        begin_epoch_locked();
+        seen = 0;
+    }
+    if (!seen && epochNumTypes < EPOCH_TYPES_MAX)
+        strcpy(epochTypes[epochNumTypes++], type);
+
+    if (epochSkipped) {
+        droppedSentences++;
+        return;
+    }
+    if (repeat_locked(nmea, length, is_gsv(type))) {
+        droppedRepeats++;
+        return;
+    }
+
+    if (nmeaDeliver)
+        nmeaDeliver(timestamp, nmea, length);
+    callbackCount++;
+}
+
+void gps_nmea_configure(gps_nmea_callback deliver, gps_nmea_mode_t mode,
+        uint32_t min_interval_ms)
+{
+    pthread_mutex_lock(&nmeaLock);
+    end_epoch_locked();
+    nmeaDeliver = deliver;
+    nmeaMode = mode;
+    nmeaMinIntervalMs = min_interval_ms;
+    lastEpochMs = 0;
+    numRepeatSlots = 0;
+    nextRepeatSlot = 0;
+    pthread_mutex_unlock(&nmeaLock);
+
+    LOGI("%s: mode %d, min interval %ums", __func__, mode, min_interval_ms);
+}
+
+void gps_nmea_sentence(GpsUtcTime timestamp, const char *nmea, int length)
+{
+    pthread_mutex_lock(&nmeaLock);
+    sentenceCount++;
+
+    switch (nmeaMode) {
+    case GPS_NMEA_MODE_PASS:
+        if (nmeaDeliver)
+            nmeaDeliver(timestamp, nmea, length);
+        callbackCount++;
+        break;
+    case GPS_NMEA_MODE_EPOCH:
+        epoch_sentence_locked(timestamp, nmea, length);
+        break;
+    case GPS_NMEA_MODE_OFF:
+        droppedSentences++;
+        break;
+    }
+
+    pthread_mutex_unlock(&nmeaLock);
+}
+
+void gps_nmea_flush(void)
+{
+    pthread_mutex_lock(&nmeaLock);
+    end_epoch_locked();
+    /* the next session starts with every sentence */
+    numRepeatSlots = 0;
+    nextRepeatSlot = 0;
+    pthread_mutex_unlock(&nmeaLock);
+}
+
+size_t gps_nmea_dump(char *buffer, size_t size)
+{
+    int n;
+
+    if (!size)
+        return 0;
+
+    pthread_mutex_lock(&nmeaLock);
+    n = snprintf(buffer, size,
+            "wrapper.nmea.mode=%d\n"
+            "wrapper.nmea.sentences=%u\n"
+            "wrapper.nmea.epochs=%u\n"
+            "wrapper.nmea.callbacks=%u\n"
+            "wrapper.nmea.dropped_sentences=%u\n"
+            "wrapper.nmea.dropped_epochs=%u\n"
+            "wrapper.nmea.dropped_repeats=%u\n",
+            nmeaMode, sentenceCount, epochCount, callbackCount,
+            droppedSentences, droppedEpochs, droppedRepeats);
+    pthread_mutex_unlock(&nmeaLock);
+
+    if (n < 0)
+        return 0;
+    return (size_t)n < size ? (size_t)n : size - 1;
+}
@@ -0,0 +1,67 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * NMEA coalescing
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef GPS_NMEA_H
+#define GPS_NMEA_H
+
+#include <hardware/gps.h>
+
+typedef enum {
+    /* every sentence is forwarded as the vendor reports it */
+    GPS_NMEA_MODE_PASS,
+    /*
+     * sentences unchanged since they were last forwarded are dropped, and
+     * epochs closer than a minimum interval are dropped whole
+     */
+    GPS_NMEA_MODE_EPOCH,
+    /* nothing is forwarded */
+    GPS_NMEA_MODE_OFF
+} gps_nmea_mode_t;
+
+/* an unchanged sentence is still forwarded this often in epoch mode */
+#define GPS_NMEA_REPEAT_REFRESH_MS 5000
+
+/** Parses "pass", "epoch" or "off", anything else is the default epoch mode. */
+gps_nmea_mode_t gps_nmea_parse_mode(const char *mode);
+
+/**
+ * Sets where sentences are delivered and how. Sentences are always
+ * delivered one per callback, as they arrive, as NmeaListener expects. In
+ * epoch mode a sentence identical to the last one forwarded of its type
+ * (and GSV page) is dropped, and epochs starting less than
+ * min_interval_ms after the last delivered one are dropped, 0 keeps them
+ * all.
+ */
+void gps_nmea_configure(gps_nmea_callback deliver, gps_nmea_mode_t mode,
+        uint32_t min_interval_ms);
+
+/** A sentence from the vendor. */
+void gps_nmea_sentence(GpsUtcTime timestamp, const char *nmea, int length);
+
+/** Ends the current epoch, e.g. when navigation stops. */
+void gps_nmea_flush(void);
+
+/**
+ * Writes the counters as text for GpsDebugInterface.
+ * @return the number of bytes written, without a terminating 0.
+ */
+size_t gps_nmea_dump(char *buffer, size_t size);
+
+#endif /* GPS_NMEA_H */
@@ -0,0 +1,256 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * reference location cache
+ *
+ * After a reboot the vendor library starts without any idea where it is,
+ * and its first fix takes a long time. The wrapper remembers the last
+ * good fix and the last cell or MAC reference location the framework
+ * handed over, keeps them in a small file across reboots, and injects
+ * them when navigation starts while they are recent enough.
+ *
+ * The file is only written when navigation stops, not for every fix.
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_TAG "gps-wrapper"
+#include <utils/Log.h>
+
+#include "gps_refloc.h"
+
+#define REFLOC_MAGIC 0x47524c43
+#define REFLOC_VERSION 1
+
+/* an injected fix gets less accurate by this much per second of age */
+#define ACCURACY_GROWTH_M_PER_S 1
+#define ACCURACY_MAX_M 25000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t have_fix;
+    uint32_t have_ref;
+    double latitude;
+    double longitude;
+    float accuracy;
+    /* UTC, in ms like GpsUtcTime */
+    int64_t fix_time;
+    int64_t ref_time;
+    AGpsRefLocation ref;
+} refloc_cache_t;
+
+static pthread_mutex_t reflocLock = PTHREAD_MUTEX_INITIALIZER;
+static refloc_cache_t cache;
+static int loaded = 0;
+static int dirty = 0;
+static char cachePath[128];
+static uint32_t fixMaxAgeS = 0;
+static uint32_t refMaxAgeS = 0;
+
+static uint32_t injectedFixes = 0;
+static uint32_t injectedRefs = 0;
+
+static int64_t utc_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void load_locked(void)
+{
+    refloc_cache_t stored;
+    ssize_t len;
+    int fd;
+
+    memset(&cache, 0, sizeof(cache));
+
+    fd = open(cachePath, O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT)
+            LOGW("%s: cannot open %s: %s", __func__, cachePath, strerror(errno));
+        return;
+    }
+    len = read(fd, &stored, sizeof(stored));
+    close(fd);
+
+    if (len != sizeof(stored) || stored.magic != REFLOC_MAGIC ||
+            stored.version != REFLOC_VERSION) {
+        LOGW("%s: ignoring %s", __func__, cachePath);
+        return;
+    }
+    cache = stored;
+}
+
+void gps_refloc_configure(const char *path, uint32_t fix_max_age_s,
+        uint32_t ref_max_age_s)
+{
+    pthread_mutex_lock(&reflocLock);
+    fixMaxAgeS = fix_max_age_s;
+    refMaxAgeS = ref_max_age_s;
+    if (!loaded) {
+        strncpy(cachePath, path, sizeof(cachePath) - 1);
+        load_locked();
+        loaded = 1;
+    }
+    pthread_mutex_unlock(&reflocLock);
+}
+
+void gps_refloc_location(const GpsLocation *location)
+{
+    if (!(location->flags & GPS_LOCATION_HAS_LAT_LONG))
+        return;
+    if ((location->flags & GPS_LOCATION_HAS_ACCURACY) &&
+            location->accuracy > GPS_REFLOC_MAX_ACCURACY_M)
+        return;
+
+    pthread_mutex_lock(&reflocLock);
+    cache.have_fix = 1;
+    cache.latitude = location->latitude;
+    cache.longitude = location->longitude;
+    cache.accuracy = (location->flags & GPS_LOCATION_HAS_ACCURACY) ?
+            location->accuracy : GPS_REFLOC_MAX_ACCURACY_M;
+    /* the engine's time is right even when the system clock is not */
+    cache.fix_time = location->timestamp ? location->timestamp : utc_ms();
+    dirty = 1;
+    pthread_mutex_unlock(&reflocLock);
+}
+
+void gps_refloc_set_ref_location(const AGpsRefLocation *ref, size_t size)
+{
+    if (size > sizeof(AGpsRefLocation))
+        size = sizeof(AGpsRefLocation);
+
+    pthread_mutex_lock(&reflocLock);
+    cache.have_ref = 1;
+    memset(&cache.ref, 0, sizeof(cache.ref));
+    memcpy(&cache.ref, ref, size);
+    cache.ref_time = utc_ms();
+    dirty = 1;
+    pthread_mutex_unlock(&reflocLock);
+}
+
+/* -1 if the clock is behind the cached time, e.g. not set yet */
+static int64_t age_s(int64_t time, int64_t now)
+{
+    return now >= time ? (now - time) / 1000 : -1;
+}
+
+/*
+ * The vendor is called with a copy of the cache and without reflocLock:
+ * it may report a location or status from inside the call, and those
+ * come back here.
+ */
+int gps_refloc_inject(const GpsInterface *gps, const AGpsRilInterface *ril)
+{
+    int64_t now = utc_ms();
+    int64_t refAge, fixAge;
+    refloc_cache_t copy;
+    int injectRef, injectFix;
+
+    pthread_mutex_lock(&reflocLock);
+    copy = cache;
+    refAge = age_s(cache.ref_time, now);
+    injectRef = ril && cache.have_ref && refMaxAgeS && refAge >= 0 && refAge < refMaxAgeS;
+    fixAge = age_s(cache.fix_time, now);
+    injectFix = cache.have_fix && fixMaxAgeS && fixAge >= 0 && fixAge < fixMaxAgeS;
+    if (injectRef)
+        injectedRefs++;
+    if (injectFix)
+        injectedFixes++;
+    pthread_mutex_unlock(&reflocLock);
+
+    if (injectRef) {
+        LOGV("%s: reference location, %llds old", __func__, (long long)refAge);
+        ril->set_ref_location(&copy.ref, sizeof(copy.ref));
+    }
+
+    if (injectFix) {
+        float accuracy = copy.accuracy + fixAge * ACCURACY_GROWTH_M_PER_S;
+        if (accuracy > ACCURACY_MAX_M)
+            accuracy = ACCURACY_MAX_M;
+        LOGV("%s: last fix, %llds old, %.0fm", __func__, (long long)fixAge, accuracy);
+        gps->inject_location(copy.latitude, copy.longitude, accuracy);
+    }
+
+    return injectRef || injectFix;
+}
+
+void gps_refloc_save(void)
+{
+    char tmpPath[sizeof(cachePath) + 4];
+    refloc_cache_t stored;
+    int fd, ok;
+
+    pthread_mutex_lock(&reflocLock);
+    if (!dirty || !loaded) {
+        pthread_mutex_unlock(&reflocLock);
+        return;
+    }
+    stored = cache;
+    stored.magic = REFLOC_MAGIC;
+    stored.version = REFLOC_VERSION;
+    dirty = 0;
+    pthread_mutex_unlock(&reflocLock);
+
+    /* a reboot while writing must not leave half a cache behind */
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", cachePath);
+    fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        LOGW("%s: cannot create %s: %s", __func__, tmpPath, strerror(errno));
+        return;
+    }
+    ok = write(fd, &stored, sizeof(stored)) == sizeof(stored) && !fsync(fd);
+    close(fd);
+
+    if (!ok || rename(tmpPath, cachePath)) {
+        LOGW("%s: cannot write %s: %s", __func__, cachePath, strerror(errno));
+        unlink(tmpPath);
+    }
+}
+
+size_t gps_refloc_dump(char *buffer, size_t size)
+{
+    int64_t now = utc_ms();
+    int n;
+
+    if (!size)
+        return 0;
+
+    pthread_mutex_lock(&reflocLock);
+    n = snprintf(buffer, size,
+            "wrapper.refloc.fix_age_s=%lld\n"
+            "wrapper.refloc.ref_age_s=%lld\n"
+            "wrapper.refloc.injected_fixes=%u\n"
+            "wrapper.refloc.injected_refs=%u\n",
+            (long long)(cache.have_fix ? age_s(cache.fix_time, now) : -1),
+            (long long)(cache.have_ref ? age_s(cache.ref_time, now) : -1),
+            injectedFixes, injectedRefs);
+    pthread_mutex_unlock(&reflocLock);
+
+    if (n < 0)
+        return 0;
+    return (size_t)n < size ? (size_t)n : size - 1;
+}
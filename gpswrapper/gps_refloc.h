@@ -0,0 +1,63 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * reference location cache
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef GPS_REFLOC_H
+#define GPS_REFLOC_H
+
+#include <hardware/gps.h>
+
+#ifndef GPS_REFLOC_PATH
+#define GPS_REFLOC_PATH "/data/gps/wrapper_refloc"
+#endif
+
+/* fixes less accurate than this are not worth remembering */
+#define GPS_REFLOC_MAX_ACCURACY_M 200
+
+/**
+ * Loads the cache from path, once. A cached fix is injected while younger
+ * than fix_max_age_s, a cell or MAC reference while younger than
+ * ref_max_age_s, 0 never injects it.
+ */
+void gps_refloc_configure(const char *path, uint32_t fix_max_age_s,
+        uint32_t ref_max_age_s);
+
+/** A fix from the vendor, remembered if it is good enough. */
+void gps_refloc_location(const GpsLocation *location);
+
+/** A reference location the framework gave the vendor. */
+void gps_refloc_set_ref_location(const AGpsRefLocation *ref, size_t size);
+
+/**
+ * Injects what is fresh enough into the vendor, the reference location
+ * only when ril is not NULL.
+ * @return nonzero if anything was injected.
+ */
+int gps_refloc_inject(const GpsInterface *gps, const AGpsRilInterface *ril);
+
+/** Writes the cache out if it changed since it was loaded or last saved. */
+void gps_refloc_save(void);
+
+/**
+ * Writes the cache state as text for GpsDebugInterface.
+ * @return the number of bytes written, without a terminating 0.
+ */
+size_t gps_refloc_dump(char *buffer, size_t size);
+
+#endif /* GPS_REFLOC_H */
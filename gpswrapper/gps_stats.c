@@ -0,0 +1,199 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * callback timing statistics
+ *
+ * Time to first fix, how often the vendor calls each callback and how
+ * long the framework spends in them. Reported through the wrapper's
+ * GpsDebugInterface, i.e. in bugreports and dumpsys location.
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_TAG "gps-wrapper"
+#include <utils/Log.h>
+
+#include "gps_stats.h"
+
+typedef struct {
+    uint32_t count;
+    int64_t total_us;
+    int64_t max_us;
+} duration_stat_t;
+
+typedef struct {
+    /* calls since navigation started */
+    uint32_t calls;
+    int64_t last_us;
+    duration_stat_t interval;
+    duration_stat_t framework;
+} callback_stat_t;
+
+static const char *callbackNames[GPS_CB_COUNT] = {
+    "location", "status", "sv_status", "nmea"
+};
+
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static callback_stat_t callbackStats[GPS_CB_COUNT];
+static int navigating = 0;
+static int64_t startUs = 0;
+static int64_t stopUs = 0;
+static int waitingFirstFix = 0;
+static int64_t lastTtffUs = -1;
+static duration_stat_t ttff;
+/* split by whether the session started with injected aiding data */
+static int startInjected = 0;
+static duration_stat_t ttffPlain;
+static duration_stat_t ttffInjected;
+
+int64_t gps_stats_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void duration_add(duration_stat_t *stat, int64_t us)
+{
+    stat->count++;
+    stat->total_us += us;
+    if (us > stat->max_us)
+        stat->max_us = us;
+}
+
+void gps_stats_start(int injected)
+{
+    int i;
+
+    pthread_mutex_lock(&statsLock);
+    navigating = 1;
+    startInjected = injected;
+    startUs = gps_stats_now_us();
+    waitingFirstFix = 1;
+    /* rates and intervals describe the current session only */
+    for (i = 0; i < GPS_CB_COUNT; i++) {
+        callbackStats[i].calls = 0;
+        callbackStats[i].last_us = 0;
+        memset(&callbackStats[i].interval, 0, sizeof(duration_stat_t));
+    }
+    pthread_mutex_unlock(&statsLock);
+}
+
+void gps_stats_stop(void)
+{
+    pthread_mutex_lock(&statsLock);
+    navigating = 0;
+    stopUs = gps_stats_now_us();
+    waitingFirstFix = 0;
+    pthread_mutex_unlock(&statsLock);
+}
+
+void gps_stats_arrival(int cb, int64_t now_us)
+{
+    callback_stat_t *stat = &callbackStats[cb];
+
+    pthread_mutex_lock(&statsLock);
+    stat->calls++;
+    if (stat->last_us)
+        duration_add(&stat->interval, now_us - stat->last_us);
+    stat->last_us = now_us;
+    pthread_mutex_unlock(&statsLock);
+}
+
+void gps_stats_location(const GpsLocation *location, int64_t now_us)
+{
+    if (!(location->flags & GPS_LOCATION_HAS_LAT_LONG))
+        return;
+
+    pthread_mutex_lock(&statsLock);
+    if (waitingFirstFix) {
+        waitingFirstFix = 0;
+        lastTtffUs = now_us - startUs;
+        duration_add(&ttff, lastTtffUs);
+        duration_add(startInjected ? &ttffInjected : &ttffPlain, lastTtffUs);
+        LOGI("%s: time to first fix %lldms%s", __func__, (long long)(lastTtffUs / 1000),
+                startInjected ? ", with injected location" : "");
+    }
+    pthread_mutex_unlock(&statsLock);
+}
+
+void gps_stats_framework(int cb, int64_t duration_us)
+{
+    pthread_mutex_lock(&statsLock);
+    duration_add(&callbackStats[cb].framework, duration_us);
+    pthread_mutex_unlock(&statsLock);
+}
+
+static int64_t average(const duration_stat_t *stat)
+{
+    return stat->count ? stat->total_us / stat->count : 0;
+}
+
+size_t gps_stats_dump(char *buffer, size_t size)
+{
+    size_t len = 0;
+    int64_t elapsed_ms;
+    int i;
+
+    if (!size)
+        return 0;
+
+    pthread_mutex_lock(&statsLock);
+
+    elapsed_ms = ((navigating ? gps_stats_now_us() : stopUs) - startUs) / 1000;
+
+#define APPEND(...) do { \
+        if (len < size) { \
+            int n = snprintf(buffer + len, size - len, __VA_ARGS__); \
+            len = n < 0 ? len : (len + n < size ? len + n : size - 1); \
+        } \
+    } while (0)
+
+    APPEND("wrapper.navigating=%d\n", navigating);
+    APPEND("wrapper.session_ms=%lld\n", (long long)(startUs ? elapsed_ms : 0));
+    APPEND("wrapper.ttff_ms=%lld\n", (long long)(lastTtffUs < 0 ? -1 : lastTtffUs / 1000));
+    APPEND("wrapper.ttff.count=%u\n", ttff.count);
+    APPEND("wrapper.ttff.avg_ms=%lld\n", (long long)(average(&ttff) / 1000));
+    APPEND("wrapper.ttff.max_ms=%lld\n", (long long)(ttff.max_us / 1000));
+    APPEND("wrapper.ttff_plain.count=%u\n", ttffPlain.count);
+    APPEND("wrapper.ttff_plain.avg_ms=%lld\n", (long long)(average(&ttffPlain) / 1000));
+    APPEND("wrapper.ttff_injected.count=%u\n", ttffInjected.count);
+    APPEND("wrapper.ttff_injected.avg_ms=%lld\n", (long long)(average(&ttffInjected) / 1000));
+
+    for (i = 0; i < GPS_CB_COUNT; i++) {
+        const callback_stat_t *stat = &callbackStats[i];
+        const char *name = callbackNames[i];
+
+        APPEND("wrapper.%s.calls=%u\n", name, stat->calls);
+        /* calls per second, times 100 */
+        APPEND("wrapper.%s.rate_x100=%lld\n", name,
+                (long long)(elapsed_ms > 0 ? (int64_t)stat->calls * 100000 / elapsed_ms : 0));
+        APPEND("wrapper.%s.interval_avg_ms=%lld\n", name, (long long)(average(&stat->interval) / 1000));
+        APPEND("wrapper.%s.interval_max_ms=%lld\n", name, (long long)(stat->interval.max_us / 1000));
+        APPEND("wrapper.%s.framework_avg_us=%lld\n", name, (long long)average(&stat->framework));
+        APPEND("wrapper.%s.framework_max_us=%lld\n", name, (long long)stat->framework.max_us);
+    }
+
+#undef APPEND
+
+    pthread_mutex_unlock(&statsLock);
+    return len;
+}
@@ -0,0 +1,61 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * callback timing statistics
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef GPS_STATS_H
+#define GPS_STATS_H
+
+#include <hardware/gps.h>
+
+/* the vendor callbacks the wrapper interposes */
+enum {
+    GPS_CB_LOCATION,
+    GPS_CB_STATUS,
+    GPS_CB_SV_STATUS,
+    GPS_CB_NMEA,
+    GPS_CB_COUNT
+};
+
+/** Monotonic clock in microseconds. */
+int64_t gps_stats_now_us(void);
+
+/**
+ * Navigation started, begins a TTFF measurement and resets the rates.
+ * injected tells whether a cached location was injected first, TTFFs
+ * are also kept separately for both kinds of start.
+ */
+void gps_stats_start(int injected);
+void gps_stats_stop(void);
+
+/** The vendor called callback cb at now_us. */
+void gps_stats_arrival(int cb, int64_t now_us);
+
+/** The vendor reported a fix at now_us, the first one after start is the TTFF. */
+void gps_stats_location(const GpsLocation *location, int64_t now_us);
+
+/** The framework's callback cb took duration_us. */
+void gps_stats_framework(int cb, int64_t duration_us);
+
+/**
+ * Writes the statistics as text for GpsDebugInterface.
+ * @return the number of bytes written, without a terminating 0.
+ */
+size_t gps_stats_dump(char *buffer, size_t size);
+
+#endif /* GPS_STATS_H */
@@ -0,0 +1,189 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * SV status suppression
+ *
+ * The vendor library reports the full satellite table every epoch. Each
+ * report is marshalled into Java and fanned out to every GpsStatus
+ * listener, even when the table is the same as a second ago. Reports
+ * that differ from the last forwarded one by less than the thresholds are
+ * not passed on, except for a periodic full update.
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_TAG "gps-wrapper"
+#include <utils/Log.h>
+
+#include "gps_sv.h"
+
+static pthread_mutex_t svLock = PTHREAD_MUTEX_INITIALIZER;
+static gps_sv_status_callback svDeliver = NULL;
+static float snrThreshold = 0;
+static float elevationThreshold = 0;
+static float azimuthThreshold = 0;
+static uint32_t maxIntervalMs = 0;
+
+static GpsSvStatus lastForwarded;
+static int haveLastForwarded = 0;
+static int64_t lastForwardedMs = 0;
+
+static uint32_t receivedCount = 0;
+static uint32_t forwardedCount = 0;
+static uint32_t periodicCount = 0;
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static float azimuth_delta(float a, float b)
+{
+    float d = fabsf(a - b);
+
+    return d > 180 ? 360 - d : d;
+}
+
+/* a threshold of 0 makes any difference count */
+static int exceeds(float delta, float threshold)
+{
+    return threshold ? delta >= threshold : delta > 0;
+}
+
+static const GpsSvInfo *find_sv(const GpsSvStatus *status, int prn)
+{
+    int i;
+
+    for (i = 0; i < status->num_svs && i < GPS_MAX_SVS; i++) {
+        if (status->sv_list[i].prn == prn)
+            return &status->sv_list[i];
+    }
+    return NULL;
+}
+
+/* called with svLock held, against the last forwarded status */
+static int changed_locked(const GpsSvStatus *status)
+{
+    int i;
+
+    if (status->num_svs != lastForwarded.num_svs ||
+            status->ephemeris_mask != lastForwarded.ephemeris_mask ||
+            status->almanac_mask != lastForwarded.almanac_mask ||
+            status->used_in_fix_mask != lastForwarded.used_in_fix_mask)
+        return 1;
+
+    for (i = 0; i < status->num_svs && i < GPS_MAX_SVS; i++) {
+        const GpsSvInfo *sv = &status->sv_list[i];
+        const GpsSvInfo *last = find_sv(&lastForwarded, sv->prn);
+
+        if (!last)
+            return 1;
+        if (exceeds(fabsf(sv->snr - last->snr), snrThreshold) ||
+                exceeds(fabsf(sv->elevation - last->elevation), elevationThreshold) ||
+                exceeds(azimuth_delta(sv->azimuth, last->azimuth), azimuthThreshold))
+            return 1;
+    }
+    return 0;
+}
+
+void gps_sv_configure(gps_sv_status_callback deliver, uint32_t snr_db,
+        uint32_t elevation_deg, uint32_t azimuth_deg, uint32_t max_interval_ms)
+{
+    pthread_mutex_lock(&svLock);
+    svDeliver = deliver;
+    snrThreshold = snr_db;
+    elevationThreshold = elevation_deg;
+    azimuthThreshold = azimuth_deg;
+    maxIntervalMs = max_interval_ms;
+    haveLastForwarded = 0;
+    pthread_mutex_unlock(&svLock);
+
+    if (snr_db || elevation_deg || azimuth_deg)
+        LOGI("%s: forwarding changes of %udB, %u/%u degrees, at least every %ums",
+                __func__, snr_db, elevation_deg, azimuth_deg, max_interval_ms);
+}
+
+void gps_sv_status(GpsSvStatus *sv_status)
+{
+    int64_t now;
+    int forward;
+
+    pthread_mutex_lock(&svLock);
+    receivedCount++;
+
+    if (!snrThreshold && !elevationThreshold && !azimuthThreshold) {
+        forwardedCount++;
+        if (svDeliver)
+            svDeliver(sv_status);
+        pthread_mutex_unlock(&svLock);
+        return;
+    }
+
+    now = now_ms();
+    forward = !haveLastForwarded || changed_locked(sv_status);
+    if (!forward && maxIntervalMs && now - lastForwardedMs >= maxIntervalMs) {
+        forward = 1;
+        periodicCount++;
+    }
+
+    if (forward) {
+        memcpy(&lastForwarded, sv_status, sizeof(lastForwarded));
+        haveLastForwarded = 1;
+        lastForwardedMs = now;
+        forwardedCount++;
+        if (svDeliver)
+            svDeliver(sv_status);
+    }
+
+    pthread_mutex_unlock(&svLock);
+}
+
+void gps_sv_reset(void)
+{
+    pthread_mutex_lock(&svLock);
+    haveLastForwarded = 0;
+    pthread_mutex_unlock(&svLock);
+}
+
+size_t gps_sv_dump(char *buffer, size_t size)
+{
+    int n;
+
+    if (!size)
+        return 0;
+
+    pthread_mutex_lock(&svLock);
+    n = snprintf(buffer, size,
+            "wrapper.sv_status.received=%u\n"
+            "wrapper.sv_status.forwarded=%u\n"
+            "wrapper.sv_status.periodic=%u\n"
+            "wrapper.sv_status.suppressed=%u\n",
+            receivedCount, forwardedCount, periodicCount,
+            receivedCount - forwardedCount);
+    pthread_mutex_unlock(&svLock);
+
+    if (n < 0)
+        return 0;
+    return (size_t)n < size ? (size_t)n : size - 1;
+}
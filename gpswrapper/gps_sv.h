@@ -0,0 +1,48 @@
+/******************************************************************************
+ * GPS HAL wrapper
+ * SV status suppression
+ *
+ * Copyright 2012 - The CyanogenMod Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef GPS_SV_H
+#define GPS_SV_H
+
+#include <hardware/gps.h>
+
+/**
+ * Sets where SV status is delivered and what counts as a change. A status
+ * is forwarded when an SV appeared or went away, a mask changed, or an SV
+ * moved by at least one of the thresholds (dB, degrees), and in any case
+ * once max_interval_ms passed since the last one forwarded. All
+ * thresholds 0 forwards every status.
+ */
+void gps_sv_configure(gps_sv_status_callback deliver, uint32_t snr_db,
+        uint32_t elevation_deg, uint32_t azimuth_deg, uint32_t max_interval_ms);
+
+/** A status from the vendor. */
+void gps_sv_status(GpsSvStatus *sv_status);
+
+/** Forgets the last forwarded status, the next one always goes through. */
+void gps_sv_reset(void);
+
+/**
+ * Writes the counters as text for GpsDebugInterface.
+ * @return the number of bytes written, without a terminating 0.
+ */
+size_t gps_sv_dump(char *buffer, size_t size);
+
+#endif /* GPS_SV_H */
@@ -20,7 +20,7 @@ LOCAL_MODULE_TAGS := optional
 
 LOCAL_SRC_FILES := main.cpp
 
-LOCAL_SHARED_LIBRARIES := libutils libbinder
+LOCAL_SHARED_LIBRARIES := libutils libbinder libcutils
 
 LOCAL_MODULE := TvOutHack
 
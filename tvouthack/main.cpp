@@ -1,11 +1,234 @@
+/*
+ * Copyright (C) 2012 The CyanogenMod Project
+ * Copyright (C) 2012 Pawit Pornkitprasan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Keeps the TV out picture updated by poking TvoutService_C once per
+ * frame. Frames are only pushed while an HDMI cable is plugged, paced by
+ * the display's vsync; otherwise the process sleeps in poll() until the
+ * HDMI switch changes.
+ *
+ * The screen state is not read: /sys/power/wait_for_fb_* belong to
+ * SurfaceFlinger, a second reader would acknowledge the sleep for it.
+ * Instead vsync failing several frames in a row, which is what a panel
+ * that is off does, pauses the updates and vsync is only tried again
+ * once a second. With the timer there is no such signal.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <linux/fb.h>
+#include <linux/netlink.h>
 #include <binder/IPCThreadState.h>
 #include <binder/ProcessState.h>
 #include <binder/IServiceManager.h>
+#include <cutils/properties.h>
+
+#define LOG_TAG "TvOutHack"
 #include <utils/Log.h>
 
+#define HDMI_SWITCH_NAME "hdmi"
+#define HDMI_SWITCH_STATE "/sys/class/switch/" HDMI_SWITCH_NAME "/state"
+#define FB_DEVICE "/dev/graphics/fb0"
+
+/* frame interval when the framebuffer cannot wait for vsync, ~60 fps */
+#define FRAME_INTERVAL_MS 16
+/* failed vsync waits in a row taken as the panel being off */
+#define VSYNC_ERROR_FRAMES 3
+/* how often vsync is tried again while the panel is off */
+#define PANEL_OFF_RETRY_MS 1000
+
+#define UEVENT_MSG_LEN 1024
+
+/* 0 makes every frame wait for the service's replies again */
+#define ONEWAY_PROPERTY "debug.tvouthack.oneway"
+/* frames between timing reports, about a minute at 60 fps */
+#define STATS_INTERVAL_FRAMES 3600
+
+#ifndef FBIO_WAITFORVSYNC
+#define FBIO_WAITFORVSYNC _IOW('F', 0x20, __u32)
+#endif
+
 using namespace android;
 
+static int read_hdmi_state() {
+    char buf[8];
+    int fd, len;
+
+    fd = open(HDMI_SWITCH_STATE, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+        return -1;
+    buf[len] = '\0';
+    return atoi(buf) != 0;
+}
+
+static int open_uevent_socket() {
+    struct sockaddr_nl addr;
+    int sz = 64 * 1024;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_pid = getpid();
+    addr.nl_groups = 0xffffffff;
+
+    fd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0)
+        return -1;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &sz, sizeof(sz));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Reads all pending uevents and updates hdmi from the ones of the HDMI
+ * switch. Everything else the kernel broadcasts is ignored.
+ */
+static void handle_uevents(int fd, int *hdmi) {
+    char msg[UEVENT_MSG_LEN + 2];
+    int len;
+
+    while ((len = recv(fd, msg, UEVENT_MSG_LEN, MSG_DONTWAIT)) > 0) {
+        const char *name = NULL, *state = NULL;
+        const char *s = msg;
+
+        msg[len] = '\0';
+        msg[len + 1] = '\0';
+
+        /* "action@devpath" followed by KEY=value strings */
+        while (*s) {
+            if (!strncmp(s, "SWITCH_NAME=", 12))
+                name = s + 12;
+            else if (!strncmp(s, "SWITCH_STATE=", 13))
+                state = s + 13;
+            s += strlen(s) + 1;
+        }
+
+        if (name && state && !strcmp(name, HDMI_SWITCH_NAME))
+            *hdmi = atoi(state) != 0;
+    }
+}
+
+static int wait_for_vsync(int fd) {
+    __u32 crtc = 0;
+    int ret;
+
+    do {
+        ret = ioctl(fd, FBIO_WAITFORVSYNC, &crtc);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+/*
+ * The per-frame transactions never change, so their parcels are built
+ * once and sent again every frame. Nothing reads the replies, which is
+ * why they can go one way unless the property says otherwise.
+ */
+#define TVOUT_FRAME_CALLS 3
+
+struct tvout_frame_t {
+    Parcel send[TVOUT_FRAME_CALLS];
+    uint32_t codes[TVOUT_FRAME_CALLS];
+    Parcel reply;
+    uint32_t flags;
+};
+
+struct tvout_stats_t {
+    uint32_t frames;
+    int64_t binderNs;
+    int64_t binderMaxNs;
+    int64_t cpuNs;
+};
+
+static int64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void init_frame(tvout_frame_t *frame) {
+    char value[PROPERTY_VALUE_MAX];
+
+    frame->codes[0] = 4;
+    frame->send[0].writeInterfaceToken(String16("android.hardware.Tvout"));
+    frame->codes[1] = 27;
+    frame->send[1].writeInterfaceToken(String16("android.hardware.ITvout"));
+    frame->codes[2] = 13;
+    frame->send[2].writeInterfaceToken(String16("android.hardware.ITvout"));
+    frame->send[2].writeInt32(0);
+
+    property_get(ONEWAY_PROPERTY, value, "1");
+    frame->flags = atoi(value) ? IBinder::FLAG_ONEWAY : 0;
+}
+
+static void update_tvout(const sp<IBinder>& tvout, tvout_frame_t *frame,
+        tvout_stats_t *stats) {
+    int64_t start = clock_ns(CLOCK_MONOTONIC);
+    int64_t cpuStart = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    int64_t elapsed;
+
+    for (int i = 0; i < TVOUT_FRAME_CALLS; i++) {
+        status_t ret = tvout->transact(frame->codes[i], frame->send[i],
+                (frame->flags & IBinder::FLAG_ONEWAY) ? NULL : &frame->reply,
+                frame->flags);
+        // A full async buffer means the service is falling behind,
+        // let it pace us again
+        if (ret != NO_ERROR && (frame->flags & IBinder::FLAG_ONEWAY)) {
+            LOGW("One way transaction %u failed (%d), waiting for replies from now on",
+                    frame->codes[i], ret);
+            frame->flags &= ~IBinder::FLAG_ONEWAY;
+        }
+    }
+
+    elapsed = clock_ns(CLOCK_MONOTONIC) - start;
+    stats->frames++;
+    stats->binderNs += elapsed;
+    if (elapsed > stats->binderMaxNs)
+        stats->binderMaxNs = elapsed;
+    stats->cpuNs += clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+}
+
+static void report_stats(tvout_stats_t *stats, bool oneway) {
+    if (!stats->frames)
+        return;
+    LOGI("%u frames%s: binder avg %lldus max %lldus, cpu avg %lldus per frame",
+            stats->frames, oneway ? " (one way)" : "",
+            (long long)(stats->binderNs / stats->frames / 1000),
+            (long long)(stats->binderMaxNs / 1000),
+            (long long)(stats->cpuNs / stats->frames / 1000));
+    memset(stats, 0, sizeof(*stats));
+}
+
 int main() {
     sp<IServiceManager> sm = defaultServiceManager();
     sp<IBinder> binder;
@@ -16,37 +239,94 @@ int main() {
         usleep(500000); // 0.5 s
     } while(true);
 
-    int ret;
-
     Parcel s2, r2;
     s2.writeInterfaceToken(String16("android.hardware.ITvoutService"));
     binder->transact(1, s2, &r2);
     sp<IBinder> binder2 = r2.readStrongBinder();
 
-    while (true) {
-        {
+    tvout_frame_t frame;
+    tvout_stats_t stats;
+    init_frame(&frame);
+    memset(&stats, 0, sizeof(stats));
+
+    struct pollfd fds[1];
+    int nfds = 0;
+    int hdmi = 1, active = 0;
+    int vsyncErrors = 0;
 
-            Parcel send, reply;
-            int code = 4;
-            send.writeInterfaceToken(String16("android.hardware.Tvout"));
-            int ret = binder2->transact(code, send, &reply);
+    int fd = open_uevent_socket();
+    if (fd >= 0) {
+        fds[0].fd = fd;
+        fds[0].events = POLLIN;
+        nfds = 1;
+    }
+    // Without either we cannot tell when to stop, push frames all the time
+    hdmi = read_hdmi_state();
+    if (hdmi < 0 || fd < 0) {
+        LOGW("Cannot follow the HDMI switch, assuming a cable is plugged");
+        hdmi = 1;
+    }
+
+    int vsyncFd = open(FB_DEVICE, O_RDWR);
+    if (vsyncFd < 0)
+        LOGW("Cannot open %s, using a %dms timer", FB_DEVICE, FRAME_INTERVAL_MS);
+
+    while (true) {
+        if (active != hdmi) {
+            active = hdmi;
+            LOGI("%s frame updates", active ? "Starting" : "Stopping");
+            if (!active)
+                report_stats(&stats, frame.flags & IBinder::FLAG_ONEWAY);
         }
-        {
 
-            Parcel send, reply;
-            int code = 27;
-            send.writeInterfaceToken(String16("android.hardware.ITvout"));
-            int ret = binder2->transact(code, send, &reply);
+        // Sleep until something changes, or only check for changes
+        // between frames
+        int timeout = -1;
+        if (active && vsyncFd < 0)
+            timeout = FRAME_INTERVAL_MS;
+        else if (active)
+            timeout = vsyncErrors >= VSYNC_ERROR_FRAMES ? PANEL_OFF_RETRY_MS : 0;
+
+        int ret = poll(fds, nfds, timeout);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            LOGE("poll failed: %s", strerror(errno));
+            return 1;
         }
-        {
 
-            Parcel send, reply;
-            int code = 13;
-            send.writeInterfaceToken(String16("android.hardware.ITvout"));
-            send.writeInt32(0);
-            int ret = binder2->transact(code, send, &reply);
+        if (nfds && (fds[0].revents & POLLIN))
+            handle_uevents(fds[0].fd, &hdmi);
+
+        if (!hdmi)
+            continue;
+
+        if (vsyncFd >= 0 && wait_for_vsync(vsyncFd) < 0) {
+            if (errno == ENOTTY || errno == EINVAL) {
+                LOGW("Cannot wait for vsync: %s, using a %dms timer", strerror(errno),
+                        FRAME_INTERVAL_MS);
+                close(vsyncFd);
+                vsyncFd = -1;
+                continue;
+            }
+            // Usually a timeout with the panel off, pace a few frames by
+            // hand, then stop pushing until vsync works again
+            if (++vsyncErrors == VSYNC_ERROR_FRAMES) {
+                LOGI("Cannot wait for vsync: %s, pausing frame updates", strerror(errno));
+                report_stats(&stats, frame.flags & IBinder::FLAG_ONEWAY);
+            }
+            if (vsyncErrors >= VSYNC_ERROR_FRAMES)
+                continue;
+            usleep(FRAME_INTERVAL_MS * 1000);
+        } else if (vsyncFd >= 0 && vsyncErrors) {
+            if (vsyncErrors >= VSYNC_ERROR_FRAMES)
+                LOGI("Resuming frame updates");
+            vsyncErrors = 0;
         }
-        usleep(15000); // Should give ~60 fps
+
+        update_tvout(binder2, &frame, &stats);
+        if (stats.frames >= STATS_INTERVAL_FRAMES)
+            report_stats(&stats, frame.flags & IBinder::FLAG_ONEWAY);
     }
     return 0;
 }